@@ -0,0 +1,366 @@
+#ifndef ACTIONGEN_H
+#define ACTIONGEN_H
+
+#include <array>
+
+#include "actionlog.h"
+#include "moveorder.h"
+#include "gliderexchange.h"
+
+// Produces the actions of one turn state in stages, each generated only when asked for
+// so a node that cuts off on a capture never pays for its quiet actions
+template <typename MiniMaxType, typename TurnState>
+class ActionGen {
+public:
+    typedef typename MiniMaxType::Board Board;
+    typedef typename MiniMaxType::SizedBitBoard SizedBitBoard;
+
+    static constexpr unsigned int num_cells = MiniMaxType::num_cells;
+
+    enum class Stage {Start, TableAction, KingCaptures, GliderCaptures, QuietGlides, Spawns, QuietMoves, Done};
+
+    // move_order may be null, in which case each stage comes out in generation order
+    // If tactical is set, quiet actions are only generated if they land next to the enemy king
+    ActionGen(const Board &board, Action table_action, const MoveOrder<num_cells> *move_order, unsigned int ply, bool tactical = false)
+        : board(board)
+        , table_action(table_action)
+        , move_order(move_order)
+        , ply(ply)
+        , tactical(tactical)
+    {
+        if (tactical) {
+            threat_cells = MiniMaxType::get_prox(board.get_enemy_kings());
+        }
+    }
+
+    bool next(Action &action) {
+        while (true) {
+            while (index < actions.size()) {
+                Action res = sorted ? actions.pick(index) : actions.get(index);
+                exchange = actions.get_score(index);
+                index++;
+
+                if (stage != Stage::TableAction && res == table_action) {continue;}
+
+                action = res;
+                return true;
+            }
+
+            if (!advance()) {return false;}
+        }
+    }
+
+    // Set once a stage finds a way to capture the enemy king, which ends generation
+    bool found_win() const {
+        return win;
+    }
+
+    // The capture that takes the enemy king, once found_win()
+    Action get_win_action() const {
+        assert(win);
+        return win_action;
+    }
+
+    Stage get_stage() const {
+        return stage;
+    }
+
+    // Expected material of the last action, if it came from one of the capture stages
+    signed int get_exchange() const {
+        assert(stage == Stage::KingCaptures || stage == Stage::GliderCaptures);
+        return exchange;
+    }
+
+    bool is_legal(const Action &action) const {
+        const unsigned int src = action.src;
+        const unsigned int dst = action.dst;
+        if (src >= num_cells || dst >= num_cells) {return false;}
+
+        switch (action.type) {
+            case ActionType::Move:
+                return TurnState::can_move && board.teammates.test(src) && board.empties.test(dst) && MiniMaxType::is_adjacent(src, dst);
+
+            case ActionType::Spawn:
+                return TurnState::can_jump && TurnState::can_spawn && board.spawns[0] > 0 && board.empties.test(dst) && MiniMaxType::get_prox(board.get_own_kings()).test(dst);
+
+            case ActionType::Jump:
+                // Taking the last king is never an action, it's found as a win by the capture stages
+                // Any piece next to one of several kings can take it, but only kings take other pieces
+                if (!board.teammates.test(src) || !board.pieces.test(dst) || board.teammates.test(dst) || is_last_king(dst)) {return false;}
+                if (TurnState::can_jump && (board.kings.test(src) || board.kings.test(dst)) && MiniMaxType::is_adjacent(src, dst)) {return true;}
+                return TurnState::can_glide && is_glide_path(src, dst);
+
+            case ActionType::Glide:
+                return TurnState::can_glide && board.teammates.test(src) && board.empties.test(dst) && is_glide_path(src, dst);
+
+            default:
+                return false;
+        }
+    }
+
+private:
+    const Board &board;
+    Action table_action;
+    const MoveOrder<num_cells> *move_order;
+    unsigned int ply;
+    bool tactical;
+    SizedBitBoard threat_cells;
+
+    Stage stage = Stage::Start;
+    bool win = false;
+    Action win_action;
+
+    ActionList actions;
+    unsigned int index = 0;
+    bool sorted = false;
+    signed int exchange = 0;
+
+    std::array<SizedBitBoard, 6> gliders;
+    SizedBitBoard stops;
+    bool has_stops = false;
+
+    bool advance() {
+        actions.clear();
+        index = 0;
+        sorted = false;
+
+        switch (stage) {
+            case Stage::Start:
+                stage = Stage::TableAction;
+                if (table_action.type != ActionType::None && is_legal(table_action)) {
+                    actions.add(table_action.type, table_action.src, table_action.dst);
+                }
+                return true;
+
+            case Stage::TableAction:
+                stage = Stage::KingCaptures;
+                if (TurnState::can_jump && gen_king_captures()) {return finish_win();}
+                order_captures();
+                return true;
+
+            case Stage::KingCaptures:
+                stage = Stage::GliderCaptures;
+                if (TurnState::can_glide && gen_gliders()) {return finish_win();}
+                order_captures();
+                return true;
+
+            case Stage::GliderCaptures:
+                stage = Stage::QuietGlides;
+                if (TurnState::can_glide) {
+                    gen_glides<0>();
+                    gen_glides<1>();
+                    gen_glides<2>();
+                    gen_glides<3>();
+                    gen_glides<4>();
+                    gen_glides<5>();
+                    order_quiet();
+                }
+                return true;
+
+            case Stage::QuietGlides:
+                stage = Stage::Spawns;
+                if (TurnState::can_jump && TurnState::can_spawn && board.spawns[0] > 0) {
+                    gen_spawns();
+                    order_quiet();
+                }
+                return true;
+
+            case Stage::Spawns:
+                stage = Stage::QuietMoves;
+                if (TurnState::can_move) {
+                    gen_moves<0>();
+                    gen_moves<1>();
+                    gen_moves<2>();
+                    gen_moves<3>();
+                    gen_moves<4>();
+                    gen_moves<5>();
+                    order_quiet();
+                }
+                return true;
+
+            case Stage::QuietMoves:
+            case Stage::Done:
+                stage = Stage::Done;
+                return false;
+        }
+
+        return false;
+    }
+
+    // The stage that found the win sets win_action first
+    bool finish_win() {
+        actions.clear();
+        stage = Stage::Done;
+        win = true;
+        return false;
+    }
+
+    // Captures are always ordered, by how the exchange on the landing cell plays out
+    void order_captures() {
+        for (unsigned int i = 0; i < actions.size(); i++) {
+            actions.set_score(i, GliderExchange<MiniMaxType>::evaluate(board, actions.get(i)));
+        }
+        sorted = true;
+    }
+
+    void order_quiet() {
+        if (move_order) {
+            move_order->order(actions, board.side, ply);
+            sorted = true;
+        }
+    }
+
+    void add_quiet(ActionType type, unsigned int src, unsigned int dst) {
+        if (!tactical || threat_cells.test(dst)) {
+            actions.add(type, src, dst);
+        }
+    }
+
+    bool is_last_king(unsigned int pos) const {
+        return board.get_enemy_kings() == SizedBitBoard::from_bits(pos);
+    }
+
+    bool gen_king_captures() {
+        // Check if any of our pieces can jump an enemy king
+        SizedBitBoard enemy_kings = board.get_enemy_kings();
+        SizedBitBoard jumpers = MiniMaxType::get_prox(enemy_kings) & board.teammates;
+        if (jumpers.has_bit()) {
+            // Only the last one wins, before that each king is a capture like any other
+            if (enemy_kings.count_set_bits() == 1) {
+                win_action = Action(ActionType::Jump, jumpers.next_bit(0), enemy_kings.next_bit(0));
+                return true;
+            }
+
+            SizedBitBoard targets = enemy_kings & MiniMaxType::get_prox(board.teammates);
+            typename SizedBitBoard::FastBitEater i;
+            while (targets.has_bit(i)) {
+                unsigned int target = targets.pop_bit(i);
+                SizedBitBoard attackers = MiniMaxType::get_prox(target) & board.teammates;
+                typename SizedBitBoard::FastBitEater j;
+                while (attackers.has_bit(j)) {
+                    actions.add(ActionType::Jump, attackers.pop_bit(j), target);
+                }
+            }
+        }
+
+        // Check if our kings can jump any other piece
+        SizedBitBoard kings = board.get_own_kings();
+        SizedBitBoard jumps = MiniMaxType::get_prox(kings) & board.pieces & ~board.teammates & ~enemy_kings;
+        typename SizedBitBoard::FastBitEater i;
+        while (jumps.has_bit(i)) {
+            unsigned int victim = jumps.pop_bit(i);
+            SizedBitBoard jumpers = MiniMaxType::get_prox(victim) & kings;
+            typename SizedBitBoard::FastBitEater j;
+            while (jumpers.has_bit(j)) {
+                actions.add(ActionType::Jump, jumpers.pop_bit(j), victim);
+            }
+        }
+
+        return false;
+    }
+
+    bool gen_gliders() {
+        return gen_glider_captures<0>()
+            || gen_glider_captures<1>()
+            || gen_glider_captures<2>()
+            || gen_glider_captures<3>()
+            || gen_glider_captures<4>()
+            || gen_glider_captures<5>();
+    }
+
+    template <unsigned int dir>
+    SizedBitBoard get_steps() const {
+        return board.teammates & board.empties.template shift<MiniMaxType::dir_offsets[dir + 3]>();
+    }
+
+    template <unsigned int dir>
+    bool gen_glider_captures() {
+        gliders[dir] = get_steps<dir>()
+            & board.teammates.template shift<MiniMaxType::dir_offsets[dir + 5]>()
+            & board.teammates.template shift<MiniMaxType::dir_offsets[dir + 1]>();
+
+        SizedBitBoard remaining = gliders[dir];
+        if (!remaining.has_bit()) {return false;}
+
+        // Gliders are rare, so most positions never need this
+        if (!has_stops) {
+            stops = ~board.empties;
+            has_stops = true;
+        }
+
+        typename SizedBitBoard::FastBitEater i;
+        while (remaining.has_bit(i)) {
+            unsigned int old_pos = remaining.pop_bit(i);
+            unsigned int new_pos = MiniMaxType::find_blocker(stops, old_pos, dir);
+            if (new_pos >= num_cells || board.teammates.test(new_pos) || !board.pieces.test(new_pos)) {continue;}
+
+            if (is_last_king(new_pos)) {
+                // Shooting the enemy's last king wins outright
+                win_action = Action(ActionType::Jump, old_pos, new_pos);
+                return true;
+            }
+
+            // Capture enemy piece
+            actions.add(ActionType::Jump, old_pos, new_pos);
+        }
+
+        return false;
+    }
+
+    template <unsigned int dir>
+    void gen_glides() {
+        SizedBitBoard remaining = gliders[dir];
+        typename SizedBitBoard::FastBitEater i;
+        while (remaining.has_bit(i)) {
+            unsigned int old_pos = remaining.pop_bit(i);
+
+            // Every cell before the first piece or the edge is a landing cell
+            unsigned int blocker = MiniMaxType::find_blocker(stops, old_pos, dir);
+            for (unsigned int new_pos = old_pos + MiniMaxType::dir_offsets[dir]; new_pos != blocker && new_pos < num_cells; new_pos += MiniMaxType::dir_offsets[dir]) {
+                add_quiet(ActionType::Glide, old_pos, new_pos);
+            }
+        }
+    }
+
+    void gen_spawns() {
+        // Check if any of our kings can spawn a piece
+        SizedBitBoard spawns = MiniMaxType::get_prox(board.get_own_kings()) & board.empties;
+        typename SizedBitBoard::FastBitEater i;
+        while (spawns.has_bit(i)) {
+            add_quiet(ActionType::Spawn, 0, spawns.pop_bit(i));
+        }
+    }
+
+    template <unsigned int dir>
+    void gen_moves() {
+        SizedBitBoard moves = get_steps<dir>();
+        if (TurnState::can_glide && !TurnState::try_move_after_glide) {
+            moves &= ~gliders[dir];
+        }
+
+        typename SizedBitBoard::FastBitEater i;
+        while (moves.has_bit(i)) {
+            unsigned int old_pos = moves.pop_bit(i);
+            add_quiet(ActionType::Move, old_pos, old_pos + MiniMaxType::dir_offsets[dir]);
+        }
+    }
+
+    // Whether a glider at src can land on dst, or hit it as the first piece in the way
+    bool is_glide_path(unsigned int src, unsigned int dst) const {
+        SizedBitBoard stops = ~board.empties;
+        for (unsigned int dir = 0; dir < 6; dir++) {
+            if (!MiniMaxType::is_glider(board, src, dir)) {continue;}
+
+            // Everything up to the first piece is reachable, so dst must come before the blocker or be it
+            unsigned int blocker = MiniMaxType::find_blocker(stops, src, dir);
+            unsigned int pos = src;
+            do {
+                pos += MiniMaxType::dir_offsets[dir];
+                if (pos == dst) {return true;}
+            } while (pos != blocker && pos < num_cells);
+        }
+        return false;
+    }
+};
+
+#endif // ACTIONGEN_H
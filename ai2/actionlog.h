@@ -1,59 +1,80 @@
 #ifndef ACTIONLOG_H
 #define ACTIONLOG_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
-enum class ActionType {Move, Jump, Glide, Spawn, EndTurn};
+enum class ActionType {None, Move, Jump, Glide, Spawn, EndTurn};
 
-class DummyActionLog {
-public:
-    void copy_actions_to(DummyActionLog empty) const {}
-    void add_action(ActionType type, unsigned int src, unsigned int dst) const {}
+struct Action {
+    Action()
+        : type(ActionType::None)
+        , src(0)
+        , dst(0)
+    {}
+
+    Action(ActionType type, unsigned int src, unsigned int dst)
+        : type(type)
+        , src(src)
+        , dst(dst)
+    {}
+
+    ActionType type;
+    unsigned int src;
+    unsigned int dst;
+
+    // Packs into 21 bits (cells must be < 512); ActionType::None packs to 0
+    static constexpr unsigned int packed_bits = 21;
+
+    std::uint32_t pack() const {
+        return (static_cast<std::uint32_t>(type) << 18) | (src << 9) | dst;
+    }
+
+    static Action unpack(std::uint32_t packed) {
+        return Action(static_cast<ActionType>(packed >> 18), (packed >> 9) & 511, packed & 511);
+    }
+
+    bool operator==(const Action &other) const {
+        return type == other.type && src == other.src && dst == other.dst;
+    }
+
+    static const char *get_type_name(ActionType type) {
+        switch (type) {
+            case ActionType::None: return "none";
+            case ActionType::Move: return "move";
+            case ActionType::Jump: return "jump";
+            case ActionType::Glide: return "glide";
+            case ActionType::Spawn: return "spawn";
+            case ActionType::EndTurn: return "end_turn";
+        }
+        return "";
+    }
+
+    std::string to_string() const {
+        if (type == ActionType::None || type == ActionType::EndTurn) {return get_type_name(type);}
+        return std::string(get_type_name(type)) + ' ' + std::to_string(src) + " -> " + std::to_string(dst);
+    }
 };
 
 class ActionLog {
 public:
-    struct Action {
-        Action(ActionType type, unsigned int src, unsigned int dst)
-            : type(type)
-            , src(src)
-            , dst(dst)
-        {}
-
-        ActionType type;
-        unsigned int src;
-        unsigned int dst;
-    };
-
     std::vector<Action> actions;
 
-    void copy_actions_to(DummyActionLog empty) const {}
-    void copy_actions_to(ActionLog &log) const {
-        log.actions = actions;
-    }
-
     void add_action(ActionType type, unsigned int src, unsigned int dst) {
         actions.emplace_back(type, src, dst);
     }
 
+    Action get_first_action() const {
+        return actions.empty() ? Action() : actions.front();
+    }
+
     std::string to_string() const {
         std::string res;
 
         std::vector<Action>::const_iterator i = actions.cbegin();
         while (i != actions.cend()) {
-            switch (i->type) {
-                case ActionType::Move: res += "move"; break;
-                case ActionType::Jump: res += "jump"; break;
-                case ActionType::Glide: res += "glide"; break;
-                case ActionType::Spawn: res += "spawn"; break;
-                case ActionType::EndTurn: res += "end_turn"; break;
-            }
-
-            res += ' ';
-            res += std::to_string(i->src);
-            res += " -> ";
-            res += std::to_string(i->dst);
+            res += i->to_string();
             res += '\n';
 
             i++;
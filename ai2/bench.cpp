@@ -0,0 +1,362 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "turnstate.h"
+#include "minimax.h"
+#include "gridcode.h"
+#include "cpudispatch.h"
+
+// Microbenchmarks for the BitBoard primitives and the Board transitions, at radius 3 to 10
+// The make/unmake and search ops compare copying a board per child with changing one in place, which sets MiniMax::in_place_by_default
+// Build with make_bench.sh and compare runs before and after changing the representation, or between instruction sets by naming one, e.g. ai2_bench avx2
+// Times are timestamp counter cycles on x86, nanoseconds elsewhere
+
+static constexpr unsigned int num_inputs = 256;
+static constexpr unsigned int num_samples = 21;
+static constexpr unsigned int ops_per_sample = 1 << 16;
+
+static unsigned long long read_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Stops the compiler from dropping a result that nothing reads
+template <typename Type>
+static void keep(const Type &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct Stats {
+    double min;
+    double median;
+    double mean;
+    double stddev;
+};
+
+// Runs op until it has done ops_per_sample operations, num_samples times over, and reports ticks per operation
+// op takes the call index and returns how many operations it did, since some calls do more than one
+template <typename Op>
+static Stats measure(Op op) {
+    std::vector<double> samples;
+
+    // One untimed sample to warm up caches and branch predictors
+    for (unsigned int sample = 0; sample <= num_samples; sample++) {
+        unsigned long long done = 0;
+        unsigned int i = 0;
+        unsigned long long start = read_ticks();
+        while (done < ops_per_sample) {
+            done += op(i++);
+        }
+        unsigned long long ticks = read_ticks() - start;
+
+        if (sample) {
+            samples.push_back(static_cast<double>(ticks) / done);
+        }
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    Stats res;
+    res.min = samples.front();
+    res.median = samples[samples.size() / 2];
+    res.mean = 0;
+    for (double sample : samples) {res.mean += sample;}
+    res.mean /= samples.size();
+    res.stddev = 0;
+    for (double sample : samples) {res.stddev += (sample - res.mean) * (sample - res.mean);}
+    res.stddev = std::sqrt(res.stddev / samples.size());
+    return res;
+}
+
+static void print(unsigned int radius, const std::string &name, const Stats &stats) {
+    std::cout << "radius " << radius
+              << std::fixed << std::setprecision(2)
+              << " op " << std::left << std::setw(16) << name << std::right
+              << " min " << std::setw(8) << stats.min
+              << " median " << std::setw(8) << stats.median
+              << " mean " << std::setw(8) << stats.mean
+              << " stddev " << std::setw(6) << stats.stddev << std::endl;
+}
+
+template <unsigned int board_rad>
+class BoardBench {
+public:
+    typedef MiniMax<board_rad, false> MiniMaxType;
+    typedef typename MiniMaxType::Board Board;
+    typedef typename MiniMaxType::SizedBitBoard SizedBitBoard;
+
+    static constexpr unsigned int num_types = static_cast<unsigned int>(ActionType::EndTurn) + 1;
+
+    static constexpr unsigned int search_plies = 2;
+
+    BoardBench()
+        : rng(board_rad)
+    {
+        SizedBitBoard cells = GridCode<MiniMaxType>::get_cells();
+
+        for (unsigned int i = 0; i < num_inputs; i++) {
+            Board board = make_board(cells);
+            boards.push_back(board);
+            bit_boards.push_back(board.pieces);
+
+            ActionGen<MiniMaxType, TurnState_Initial> gen(board, Action(), 0, 0);
+            Action action;
+            while (gen.next(action)) {
+                actions[static_cast<unsigned int>(action.type)].push_back(Sample{i, action});
+                all_actions.push_back(Sample{i, action});
+            }
+        }
+
+        std::shuffle(all_actions.begin(), all_actions.end(), rng);
+        scratch_boards = boards;
+    }
+
+    void run() {
+        print(board_rad, "and", measure([this](unsigned int i) {
+            keep(bit_boards[i % num_inputs] & bit_boards[(i + 1) % num_inputs]);
+            return 1;
+        }));
+        print(board_rad, "or", measure([this](unsigned int i) {
+            keep(bit_boards[i % num_inputs] | bit_boards[(i + 1) % num_inputs]);
+            return 1;
+        }));
+        print(board_rad, "xor", measure([this](unsigned int i) {
+            keep(bit_boards[i % num_inputs] ^ bit_boards[(i + 1) % num_inputs]);
+            return 1;
+        }));
+        print(board_rad, "not", measure([this](unsigned int i) {
+            keep(~bit_boards[i % num_inputs]);
+            return 1;
+        }));
+
+        bench_shift<1>("shift +1");
+        bench_shift<4>("shift -1");
+        bench_shift<2>("shift +width");
+        bench_shift<0>("shift -width+1");
+
+        print(board_rad, "count_set_bits", measure([this](unsigned int i) {
+            keep(bit_boards[i % num_inputs].count_set_bits());
+            return 1;
+        }));
+
+        // Per bit popped, including finding the next word
+        bench_pop<typename SizedBitBoard::FirstBitEater>("pop_bit first");
+        bench_pop<typename SizedBitBoard::LastBitEater>("pop_bit last");
+
+        print(board_rad, "calc_hash", measure([this](unsigned int i) {
+            keep(bit_boards[i % num_inputs].calc_hash());
+            return 1;
+        }));
+
+        bench_transition(ActionType::Move, "Board::move");
+        bench_transition(ActionType::Jump, "Board::jump");
+        bench_transition(ActionType::Glide, "Board::glide");
+        bench_transition(ActionType::Spawn, "Board::spawn");
+
+        print(board_rad, "flip_teams", measure([this](unsigned int i) {
+            keep(boards[i % num_inputs].template flip_teams<Board>());
+            return 1;
+        }));
+
+        print(board_rad, "calc_score", measure([this](unsigned int i) {
+            keep(boards[i % num_inputs].calc_score());
+            return 1;
+        }));
+        print(board_rad, "Evaluation", measure([this](unsigned int i) {
+            keep(Evaluation<MiniMaxType>::evaluate(boards[i % num_inputs]));
+            return 1;
+        }));
+
+        // The positional terms alone, one board at a time and then max_boards at a time, per board including filling the batch
+        print(board_rad, "Eval terms", measure([this](unsigned int i) {
+            keep(Evaluation<MiniMaxType>::calc_positional_score(boards[i % num_inputs]));
+            return 1;
+        }));
+        print(board_rad, "Eval batch", measure([this](unsigned int i) {
+            static constexpr unsigned int max_boards = EvaluationBatch<MiniMaxType>::max_boards;
+            EvaluationBatch<MiniMaxType> batch;
+            for (unsigned int j = 0; j < max_boards; j++) {
+                batch.add(boards[(i * max_boards + j) % num_inputs]);
+            }
+            std::array<signed int, max_boards> scores;
+            batch.calc_positional_scores(scores.data());
+            keep(scores);
+            return max_boards;
+        }));
+
+        // The weights don't change the cost, so a network that counts material will do
+        // A refresh scores a board with nothing to start from; each child starts from its parent's accumulator, like in a
+        // search, and includes making it and a share of setting up its parent
+        Network network = Network::make_material(MiniMaxShared::piece_value);
+        print(board_rad, "Network refresh", measure([this, &network](unsigned int i) {
+            keep(NetworkEval<board_rad>::evaluate(network, boards[i % num_inputs]));
+            return 1;
+        }));
+        std::vector<Sample> by_board = all_actions;
+        std::stable_sort(by_board.begin(), by_board.end(), [](const Sample &a, const Sample &b) {return a.board < b.board;});
+        Board parent;
+        print(board_rad, "Network child", measure([this, &network, &by_board, &parent](unsigned int i) {
+            const Sample &sample = by_board[i % by_board.size()];
+            if (i == 0 || by_board[(i - 1) % by_board.size()].board != sample.board) {
+                parent = boards[sample.board];
+                NetworkEval<board_rad>::attach(network, parent);
+            }
+            keep(NetworkEval<board_rad>::evaluate(network, parent.apply(sample.action).template flip_teams<Board>()));
+            return 1;
+        }));
+
+        // From a board to a child ready to search, and back, the way each make mode does it
+        print(board_rad, "copy child", measure([this](unsigned int i) {
+            const Sample &sample = all_actions[i % all_actions.size()];
+            keep(boards[sample.board].apply(sample.action).template flip_teams<Board>());
+            return 1;
+        }));
+        print(board_rad, "make/unmake", measure([this](unsigned int i) {
+            const Sample &sample = all_actions[i % all_actions.size()];
+            Board &board = scratch_boards[sample.board];
+            typename Board::Undo undo = board.make(sample.action);
+            board.flip();
+            keep(board);
+            board.flip();
+            board.unmake(undo);
+            return 1;
+        }));
+
+        bench_search(MiniMaxShared::MakeMode::Copy, "search copy");
+        bench_search(MiniMaxShared::MakeMode::InPlace, "search in place");
+        bench_search(MiniMaxShared::MakeMode::Copy, "search batched", true);
+
+        // Every action of a turn's first step, per position
+        print(board_rad, "ActionGen", measure([this](unsigned int i) {
+            ActionGen<MiniMaxType, TurnState_Initial> gen(boards[i % num_inputs], Action(), 0, 0);
+            Action action;
+            unsigned int count = 0;
+            while (gen.next(action)) {count++;}
+            keep(count);
+            return 1;
+        }));
+    }
+
+private:
+    struct Sample {
+        unsigned int board;
+        Action action;
+    };
+
+    std::mt19937 rng;
+    std::vector<Board> boards;
+    std::vector<SizedBitBoard> bit_boards;
+    std::array<std::vector<Sample>, num_types> actions;
+    std::vector<Sample> all_actions;
+    std::vector<Board> scratch_boards;
+
+    // Random positions about as crowded as the middle of a game
+    Board make_board(const SizedBitBoard &cells) {
+        std::vector<unsigned int> free_cells;
+        for (unsigned int i = 0; i < MiniMaxType::num_cells; i++) {
+            if (cells.test(i)) {free_cells.push_back(i);}
+        }
+        std::shuffle(free_cells.begin(), free_cells.end(), rng);
+
+        unsigned int per_team = free_cells.size() / 5;
+        SizedBitBoard teammates = SizedBitBoard::from_bits();
+        SizedBitBoard pieces = SizedBitBoard::from_bits();
+        for (unsigned int i = 0; i < per_team * 2; i++) {
+            pieces |= SizedBitBoard::from_bits(free_cells[i]);
+            if (i < per_team) {teammates |= SizedBitBoard::from_bits(free_cells[i]);}
+        }
+
+        SizedBitBoard kings = SizedBitBoard::from_bits(free_cells[0], free_cells[per_team]);
+        return Board(cells & ~pieces, pieces, teammates, kings, {{3, 3}}, 0);
+    }
+
+    template <unsigned int dir>
+    void bench_shift(const std::string &name) {
+        print(board_rad, name, measure([this](unsigned int i) {
+            keep(bit_boards[i % num_inputs].template shift<MiniMaxType::dir_offsets[dir]>());
+            return 1;
+        }));
+    }
+
+    template <typename Eater>
+    void bench_pop(const std::string &name) {
+        print(board_rad, name, measure([this](unsigned int i) {
+            SizedBitBoard bit_board = bit_boards[i % num_inputs];
+            unsigned int count = 0;
+            Eater eater;
+            while (bit_board.has_bit(eater)) {
+                keep(bit_board.pop_bit(eater));
+                count++;
+            }
+            return count;
+        }));
+    }
+
+    // Per node of a shallow search from each position, quiescence included
+    void bench_search(MiniMaxShared::MakeMode mode, const std::string &name, bool batch_eval = false) {
+        MiniMaxShared::make_mode = mode;
+        MiniMaxShared::use_batch_eval = batch_eval;
+        MiniMaxShared::transposition_table.clear();
+        print(board_rad, name, measure([this](unsigned int i) {
+            Board board = boards[i % num_inputs];
+            unsigned long long nodes = MiniMaxShared::nodes;
+            keep(MiniMaxType(search_plies + 1).calc_score(board));
+            return MiniMaxShared::nodes - nodes;
+        }));
+        MiniMaxShared::make_mode = MiniMaxShared::MakeMode::Auto;
+        MiniMaxShared::use_batch_eval = false;
+    }
+
+    void bench_transition(ActionType type, const std::string &name) {
+        const std::vector<Sample> &samples = actions[static_cast<unsigned int>(type)];
+        if (samples.empty()) {
+            std::cout << "radius " << board_rad << " op " << name << " has no samples" << std::endl;
+            return;
+        }
+
+        print(board_rad, name, measure([this, &samples](unsigned int i) {
+            const Sample &sample = samples[i % samples.size()];
+            keep(boards[sample.board].apply(sample.action));
+            return 1;
+        }));
+    }
+};
+
+template <unsigned int board_rad>
+static void run_bench() {
+    BoardBench<board_rad>().run();
+}
+
+int main(int argc, char **argv) {
+    // Runs on the best instruction set the CPU has, unless one is named
+    if (argc > 1) {
+        CpuDispatch::Isa isa;
+        if (!CpuDispatch::parse_name(argv[1], isa) || !CpuDispatch::set_active(isa)) {
+            std::cerr << "Can't run on instruction set " << argv[1] << std::endl;
+            return 1;
+        }
+    }
+    std::cout << "isa " << CpuDispatch::get_name(CpuDispatch::get_active()) << std::endl;
+
+    run_bench<3>();
+    run_bench<4>();
+    run_bench<5>();
+    run_bench<6>();
+    run_bench<7>();
+    run_bench<8>();
+    run_bench<10>();
+    return 0;
+}
@@ -1,12 +1,198 @@
 #include <cstddef>
+#include <cstdint>
+#include <type_traits>
 #include <limits.h>
 #include <assert.h>
 
 #include "jw_util/fastmath.h"
 #include "jw_util/hash.h"
 
+#include "bitboardsimd.h"
+
+// Boards that fit in one native integer use it directly, anything bigger falls back to an array of words
 template <unsigned int bits>
+struct BitBoardWord {
+    typedef typename std::conditional<bits <= 64, std::uint64_t,
+        typename std::conditional<bits <= 128, unsigned __int128, void>::type>::type type;
+};
+
+template <unsigned int bits, typename Word = typename BitBoardWord<bits>::type>
 class BitBoard {
+public:
+    typedef Word DataType;
+
+    static constexpr unsigned int word_bits = sizeof(DataType) * CHAR_BIT;
+    static constexpr unsigned int size = 1;
+
+    static_assert(bits <= word_bits, "Too many bits for the word");
+
+    template <typename... BitsTypes>
+    static BitBoard<bits> from_bits(BitsTypes... poses) {
+        BitBoard<bits> res;
+        res.clear();
+        res.set_bits(poses...);
+        return res;
+    }
+
+    template <signed int interval, signed int start>
+    static BitBoard<bits> get_pattern() {
+        static BitBoard<bits> initial = make_pattern<interval>(interval > 0 ? 0 : bits - 1);
+        return initial.template shift<start - (interval > 0 ? 0 : static_cast<signed int>(bits) - 1)>();
+    }
+
+    void clear() {
+        data = 0;
+    }
+
+    bool operator==(const BitBoard<bits> &other) const {
+        return data == other.data;
+    }
+
+    // Like the array version, bits past the end aren't masked off, so ~ and shifts can set them
+    BitBoard<bits> operator~() const {return make(~data);}
+
+    BitBoard<bits> operator&(const BitBoard<bits> &other) const {return make(data & other.data);}
+    BitBoard<bits> operator|(const BitBoard<bits> &other) const {return make(data | other.data);}
+    BitBoard<bits> operator^(const BitBoard<bits> &other) const {return make(data ^ other.data);}
+
+    BitBoard<bits> &operator&=(const BitBoard<bits> &other) {data &= other.data; return *this;}
+    BitBoard<bits> &operator|=(const BitBoard<bits> &other) {data |= other.data; return *this;}
+    BitBoard<bits> &operator^=(const BitBoard<bits> &other) {data ^= other.data; return *this;}
+
+    template <signed int offset>
+    BitBoard<bits> shift() const {
+        static_assert((offset > 0 ? offset : -offset) < bits, "Cannot shift by that many bits");
+
+        if (offset > 0) {return make(data << (offset > 0 ? offset : 0));}
+        if (offset < 0) {return make(data >> (offset < 0 ? -offset : 0));}
+        return *this;
+    }
+
+    bool has_bit() const {
+        return data != 0;
+    }
+
+    // Only one word, so the eaters have nothing to remember
+    struct FirstBitEater {};
+    bool has_bit(FirstBitEater &) const {
+        return data != 0;
+    }
+    unsigned int pop_bit(FirstBitEater &) {
+        assert(data != 0);
+        unsigned int pos = count_trailing_zeros(data);
+        data &= data - 1;
+        return pos;
+    }
+
+    struct LastBitEater {};
+    bool has_bit(LastBitEater &) const {
+        return data != 0;
+    }
+    unsigned int pop_bit(LastBitEater &) {
+        assert(data != 0);
+        unsigned int pos = (word_bits - 1) - count_leading_zeros(data);
+        data ^= static_cast<DataType>(1) << pos;
+        return pos;
+    }
+
+    typedef FirstBitEater FastBitEater;
+
+    // The first set bit at or after pos, or bits if there's none
+    unsigned int next_bit(unsigned int pos) const {
+        if (pos >= bits) {return bits;}
+        DataType rest = data & (~static_cast<DataType>(0) << pos);
+        return rest ? count_trailing_zeros(rest) : bits;
+    }
+
+    // The last set bit at or before pos, or bits if there's none
+    unsigned int prev_bit(unsigned int pos) const {
+        if (pos >= bits) {return bits;}
+        DataType rest = data & (~static_cast<DataType>(0) >> (word_bits - 1 - pos));
+        return rest ? (word_bits - 1) - count_leading_zeros(rest) : bits;
+    }
+
+    unsigned int count_set_bits() const {
+        return count_ones(data);
+    }
+
+    bool test(unsigned int pos) const {
+        assert(pos < bits);
+        return (data >> pos) & 1;
+    }
+
+    void toggle_bit(unsigned int pos) {
+        assert(pos < bits);
+        data ^= static_cast<DataType>(1) << pos;
+    }
+
+    // The bits 64 at a time from the bottom, whatever they're stored in, for code that lays boards out its own way
+    static constexpr unsigned int num_words64 = jw_util::FastMath::div_ceil(bits, 64u);
+
+    std::uint64_t get_word64(unsigned int i) const {
+        assert(i < num_words64);
+        return static_cast<std::uint64_t>(data >> (i * 64));
+    }
+
+    // Matches the array version word for word
+    std::size_t calc_hash() const {
+        return hash_words(data);
+    }
+
+private:
+    DataType data;
+
+    static BitBoard<bits> make(DataType data) {
+        BitBoard<bits> res;
+        res.data = data;
+        return res;
+    }
+
+    template <typename... RestBitTypes>
+    void set_bits(unsigned int pos, RestBitTypes ... rest) {
+        assert(pos < bits);
+        data |= static_cast<DataType>(1) << pos;
+        set_bits(rest...);
+    }
+    void set_bits() {}
+
+    template <signed int interval>
+    static BitBoard<bits> make_pattern(signed int start) {
+        static_assert(interval != 0, "Interval cannot be zero");
+
+        BitBoard<bits> res;
+        res.clear();
+
+        while (start >= 0 && start < static_cast<signed int>(bits)) {
+            res.set_bits(start);
+            start += interval;
+        }
+
+        return res;
+    }
+
+    static unsigned int count_trailing_zeros(std::uint64_t word) {return __builtin_ctzll(word);}
+    static unsigned int count_leading_zeros(std::uint64_t word) {return __builtin_clzll(word);}
+    static unsigned int count_ones(std::uint64_t word) {return __builtin_popcountll(word);}
+    static std::size_t hash_words(std::uint64_t word) {return word;}
+
+    static unsigned int count_trailing_zeros(unsigned __int128 word) {
+        std::uint64_t low = static_cast<std::uint64_t>(word);
+        return low ? __builtin_ctzll(low) : 64 + __builtin_ctzll(static_cast<std::uint64_t>(word >> 64));
+    }
+    static unsigned int count_leading_zeros(unsigned __int128 word) {
+        std::uint64_t high = static_cast<std::uint64_t>(word >> 64);
+        return high ? __builtin_clzll(high) : 64 + __builtin_clzll(static_cast<std::uint64_t>(word));
+    }
+    static unsigned int count_ones(unsigned __int128 word) {
+        return __builtin_popcountll(static_cast<std::uint64_t>(word)) + __builtin_popcountll(static_cast<std::uint64_t>(word >> 64));
+    }
+    static std::size_t hash_words(unsigned __int128 word) {
+        return jw_util::Hash::combine(static_cast<std::size_t>(word), static_cast<std::size_t>(word >> 64));
+    }
+};
+
+template <unsigned int bits>
+class BitBoard<bits, void> {
 public:
     typedef std::size_t DataType;
 
@@ -21,11 +207,11 @@ public:
 		return res;
 	}
 
-	template <signed int interval>
-    static BitBoard<bits> get_pattern(signed int start) {
-		static constexpr unsigned int initial_start = interval > 0 ? 0 : size - 1;
+	template <signed int interval, signed int start>
+    static BitBoard<bits> get_pattern() {
+		static constexpr signed int initial_start = interval > 0 ? 0 : bits - 1;
 		static BitBoard<bits> initial = make_pattern<interval>(initial_start);
-		return initial.shift<start - initial_start>();
+		return initial.template shift<start - initial_start>();
 	}
 
 	void clear() {
@@ -38,96 +224,51 @@ public:
 
     BitBoard<bits> operator~() const {
         BitBoard<bits> res;
-        for (unsigned int i = 0; i < size; i++) {
-            res.data[i] = ~data[i];
-        }
+        Words::bit_not(res.data.data(), data.data());
         return res;
     }
 
-	BitBoard<bits> operator&(const BitBoard<bits> &other) const {
-		BitBoard<bits> res;
-		for (unsigned int i = 0; i < size; i++) {
-			res.data[i] = data[i] & other.data[i];
-		}
-		return res;
-	}
+    BitBoard<bits> operator&(const BitBoard<bits> &other) const {
+        BitBoard<bits> res;
+        Words::bit_and(res.data.data(), data.data(), other.data.data());
+        return res;
+    }
     BitBoard<bits>& operator &=(const BitBoard<bits> &other) {
-        for (unsigned int i = 0; i < size; i++) {
-            data[i] &= other.data[i];
-        }
+        Words::bit_and(data.data(), data.data(), other.data.data());
         return (*this);
     }
 
-	BitBoard<bits> operator|(const BitBoard<bits> &other) const {
-		BitBoard<bits> res;
-		for (unsigned int i = 0; i < size; i++) {
-			res.data[i] = data[i] | other.data[i];
-		}
-		return res;
-	}
+    BitBoard<bits> operator|(const BitBoard<bits> &other) const {
+        BitBoard<bits> res;
+        Words::bit_or(res.data.data(), data.data(), other.data.data());
+        return res;
+    }
     BitBoard<bits>& operator |=(const BitBoard<bits> &other) {
-        for (unsigned int i = 0; i < size; i++) {
-            data[i] |= other.data[i];
-        }
+        Words::bit_or(data.data(), data.data(), other.data.data());
         return (*this);
     }
 
-	BitBoard<bits> operator^(const BitBoard<bits> &other) const {
-		BitBoard<bits> res;
-		for (unsigned int i = 0; i < size; i++) {
-			res.data[i] = data[i] ^ other.data[i];
-		}
-		return res;
-	}
+    BitBoard<bits> operator^(const BitBoard<bits> &other) const {
+        BitBoard<bits> res;
+        Words::bit_xor(res.data.data(), data.data(), other.data.data());
+        return res;
+    }
     BitBoard<bits>& operator ^=(const BitBoard<bits> &other) {
-        for (unsigned int i = 0; i < size; i++) {
-            data[i] ^= other.data[i];
-        }
+        Words::bit_xor(data.data(), data.data(), other.data.data());
         return (*this);
     }
 
-	template <signed int offset>
+    template <signed int offset>
     BitBoard<bits> shift() const {
         static_assert((offset > 0 ? offset : -offset) < bits, "Cannot shift by that many bits");
 
         BitBoard<bits> res;
-
-        if (offset > 0) {
-            static constexpr unsigned int offset_word = offset / word_bits;
-            static constexpr unsigned int offset_bits = offset % word_bits;
-
-            std::fill(res.data.begin(), res.data.begin() + offset_word, 0);
-            res.data[offset_word] = data[0] << offset_bits;
-            for (unsigned int i = offset_word + 1; i < size; i++) {
-                res.data[i] = (data[i - offset_word] << offset_bits) | (data[i - 1 + offset_word] >> (word_bits - offset_bits));
-            }
-
-        } else if (offset < 0) {
-            static constexpr unsigned int offset_word = (-offset) / word_bits;
-            static constexpr unsigned int offset_bits = (-offset) % word_bits;
-
-            for (unsigned int i = 0; i < size - 1 - offset_word; i++) {
-                if (offset_bits) {
-                    res.data[i] = (data[i + 1 + offset_word] << (word_bits - offset_bits)) | (data[i + offset_word] >> offset_bits);
-                } else {
-                    res.data[i] = data[i + offset_word];
-                }
-            }
-            res.data[size - 1 - offset_word] = data[size - 1] >> offset_bits;
-            std::fill(res.data.end() - offset_word, res.data.end(), 0);
-
-        } else {
-            res = *this;
-        }
-
+        Words::template shift<offset>(res.data.data(), data.data());
         return res;
-	}
+    }
 
     bool has_bit() const {
-        for (unsigned int i = 0; i < size; i++) {
-            if (data[i]) {return true;}
-        }
-        return false;
+        return Words::any(data.data());
     }
 
     struct FirstBitEater {
@@ -166,19 +307,53 @@ public:
 
     typedef FirstBitEater FastBitEater;
 
-	unsigned int count_set_bits() const {
-		unsigned int res = 0;
-		for (unsigned int i = 0; i < size; i++) {
-			res += __builtin_popcountll(data[i]);
-		}
-		return res;
-	}
+    // The first set bit at or after pos, or bits if there's none
+    unsigned int next_bit(unsigned int pos) const {
+        if (pos >= bits) {return bits;}
+        unsigned int el_id = pos / word_bits;
+        DataType rest = data[el_id] & (~static_cast<DataType>(0) << (pos % word_bits));
+        while (!rest) {
+            if (++el_id == size) {return bits;}
+            rest = data[el_id];
+        }
+        return el_id * word_bits + __builtin_ctzll(rest);
+    }
+
+    // The last set bit at or before pos, or bits if there's none
+    unsigned int prev_bit(unsigned int pos) const {
+        if (pos >= bits) {return bits;}
+        unsigned int el_id = pos / word_bits;
+        DataType rest = data[el_id] & (~static_cast<DataType>(0) >> (word_bits - 1 - pos % word_bits));
+        while (!rest) {
+            if (el_id-- == 0) {return bits;}
+            rest = data[el_id];
+        }
+        return el_id * word_bits + (word_bits - 1) - __builtin_clzll(rest);
+    }
+
+    unsigned int count_set_bits() const {
+        return Words::count(data.data());
+    }
 
     bool test(unsigned int pos) const {
         assert(pos < bits);
         return (data[pos / word_bits] >> (pos % word_bits)) & 1;
     }
 
+    // Only touches the one word, unlike XORing in a from_bits() mask
+    void toggle_bit(unsigned int pos) {
+        assert(pos < bits);
+        data[pos / word_bits] ^= static_cast<DataType>(1) << (pos % word_bits);
+    }
+
+    // Matches the single word version
+    static constexpr unsigned int num_words64 = size;
+
+    std::uint64_t get_word64(unsigned int i) const {
+        assert(i < num_words64);
+        return data[i];
+    }
+
     std::size_t calc_hash() const {
         std::size_t res = data[0];
         for (unsigned int i = 1; i < size; i++) {
@@ -188,6 +363,8 @@ public:
     }
 
 private:
+    typedef BitBoardWords<DataType, size> Words;
+
 	std::array<DataType, size> data;
 
 	template <typename... RestBitTypes>
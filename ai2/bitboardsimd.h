@@ -0,0 +1,338 @@
+#ifndef BITBOARDSIMD_H
+#define BITBOARDSIMD_H
+
+#include <cstdint>
+#include <limits.h>
+
+#include "cpudispatch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BITBOARD_WORDS_X86
+#include <immintrin.h>
+#endif
+
+// These sit on the hottest paths of the search, and GCC won't always inline them by itself
+#define BITBOARD_WORDS_INLINE inline __attribute__((always_inline))
+// Going through pointers stops GCC unrolling the short loops itself, which costs a lot at two or three words
+#define BITBOARD_WORDS_UNROLL _Pragma("GCC unroll 16")
+
+// Each instruction set gets its own copy of the loops, compiled for it whatever flags the rest of the build uses
+// A copy can inline the ones below it, but not the other way round, so only the public entry points branch on the ISA
+#define BITBOARD_WORDS_AVX2 inline __attribute__((target("avx2,bmi2,popcnt")))
+#define BITBOARD_WORDS_AVX512 inline __attribute__((target("avx2,bmi2,popcnt,avx512f")))
+#define BITBOARD_WORDS_AVX512_POPCNT inline __attribute__((target("avx2,bmi2,popcnt,avx512f,avx512vpopcntdq")))
+
+// Calls the copy for the active ISA if worth_call, and the inlined scalar loops otherwise
+#ifdef BITBOARD_WORDS_X86
+#define BITBOARD_WORDS_DISPATCH(worth_call, ...) \
+    if (worth_call) { \
+        switch (CpuDispatch::get_active()) { \
+            case CpuDispatch::Isa::Avx512Popcnt: return Avx512Popcnt::__VA_ARGS__; \
+            case CpuDispatch::Isa::Avx512: return Avx512::__VA_ARGS__; \
+            case CpuDispatch::Isa::Avx2: return Avx2::__VA_ARGS__; \
+            default: break; \
+        } \
+    } \
+    return Scalar::__VA_ARGS__;
+#else
+#define BITBOARD_WORDS_DISPATCH(worth_call, ...) return Scalar::__VA_ARGS__;
+#endif
+
+// Whole-board operations on the word arrays of boards too big for one native integer
+// Uses AVX-512 or AVX2 when CpuDispatch picked them, and plain loops otherwise
+// Every path gives the same result, so the ISA can be switched between searches
+template <typename Word, unsigned int size>
+class BitBoardWords {
+public:
+    static_assert(sizeof(Word) == 8, "Vector paths assume 64-bit words");
+
+    static constexpr unsigned int word_bits = sizeof(Word) * CHAR_BIT;
+
+    // A call into a vectorized copy costs as much as several words of inlined loop, which GCC already does with SSE2
+    // Measured with bench.cpp, shifts only gain from 16 words and the bitwise ops from about 32, while count gains from popcnt at any size
+    static constexpr bool vector_bitwise = size >= 32;
+    static constexpr bool vector_shift = size >= 16;
+
+    static BITBOARD_WORDS_INLINE void bit_and(Word *res, const Word *a, const Word *b) {BITBOARD_WORDS_DISPATCH(vector_bitwise, template binary<And>(res, a, b))}
+    static BITBOARD_WORDS_INLINE void bit_or(Word *res, const Word *a, const Word *b) {BITBOARD_WORDS_DISPATCH(vector_bitwise, template binary<Or>(res, a, b))}
+    static BITBOARD_WORDS_INLINE void bit_xor(Word *res, const Word *a, const Word *b) {BITBOARD_WORDS_DISPATCH(vector_bitwise, template binary<Xor>(res, a, b))}
+    static BITBOARD_WORDS_INLINE void bit_not(Word *res, const Word *a) {BITBOARD_WORDS_DISPATCH(vector_bitwise, bit_not(res, a))}
+    static BITBOARD_WORDS_INLINE bool any(const Word *a) {BITBOARD_WORDS_DISPATCH(vector_bitwise, any(a))}
+    static BITBOARD_WORDS_INLINE unsigned int count(const Word *a) {BITBOARD_WORDS_DISPATCH(true, count(a))}
+
+    // Moves every bit up by offset (down if negative), filling with zeros
+    template <signed int offset>
+    static BITBOARD_WORDS_INLINE void shift(Word *res, const Word *a) {
+        static constexpr unsigned int distance = offset > 0 ? offset : -offset;
+        static_assert(distance / word_bits < size, "Cannot shift by that many bits");
+
+        if (offset > 0) {
+            BITBOARD_WORDS_DISPATCH(vector_shift, template shift_up<distance / word_bits, distance % word_bits>(res, a))
+        } else if (offset < 0) {
+            BITBOARD_WORDS_DISPATCH(vector_shift, template shift_down<distance / word_bits, distance % word_bits>(res, a))
+        } else {
+            BITBOARD_WORDS_UNROLL
+            for (unsigned int i = 0; i < size; i++) {
+                res[i] = a[i];
+            }
+        }
+    }
+
+private:
+    // Every ISA does the words from begin on, and hands the ones it can't fill a register with down to the next
+    // Constant bounds let the compiler unroll the leftover loops completely
+    struct Scalar {
+        template <typename Op, unsigned int begin = 0>
+        static BITBOARD_WORDS_INLINE void binary(Word *res, const Word *a, const Word *b) {
+            BITBOARD_WORDS_UNROLL
+            for (unsigned int i = begin; i < size; i++) {
+                res[i] = Op::apply(a[i], b[i]);
+            }
+        }
+
+        template <unsigned int begin = 0>
+        static BITBOARD_WORDS_INLINE void bit_not(Word *res, const Word *a) {
+            BITBOARD_WORDS_UNROLL
+            for (unsigned int i = begin; i < size; i++) {
+                res[i] = ~a[i];
+            }
+        }
+
+        template <unsigned int begin = 0>
+        static BITBOARD_WORDS_INLINE bool any(const Word *a) {
+            BITBOARD_WORDS_UNROLL
+            for (unsigned int i = begin; i < size; i++) {
+                if (a[i]) {return true;}
+            }
+            return false;
+        }
+
+        // A popcnt per word beats a nibble lookup at these sizes, once the ISA has the instruction
+        template <unsigned int begin = 0>
+        static BITBOARD_WORDS_INLINE unsigned int count(const Word *a) {
+            unsigned int res = 0;
+            BITBOARD_WORDS_UNROLL
+            for (unsigned int i = begin; i < size; i++) {
+                res += __builtin_popcountll(a[i]);
+            }
+            return res;
+        }
+
+        // res[i] = a[i - words] << bits | a[i - words - 1] >> (64 - bits)
+        // Both inputs are just the source read at two fixed distances, so whole vectors of words can be done at once
+        template <unsigned int words, unsigned int bits, unsigned int begin = words + 1>
+        static BITBOARD_WORDS_INLINE void shift_up(Word *res, const Word *a) {
+            BITBOARD_WORDS_UNROLL
+            for (unsigned int i = 0; i < words; i++) {
+                res[i] = 0;
+            }
+            res[words] = a[0] << bits;
+            BITBOARD_WORDS_UNROLL
+            for (unsigned int i = begin; i < size; i++) {
+                res[i] = bits ? (a[i - words] << bits) | (a[i - words - 1] >> ((word_bits - bits) % word_bits)) : a[i - words];
+            }
+        }
+
+        // res[i] = a[i + words] >> bits | a[i + words + 1] << (64 - bits)
+        template <unsigned int words, unsigned int bits, unsigned int begin = 0>
+        static BITBOARD_WORDS_INLINE void shift_down(Word *res, const Word *a) {
+            static constexpr unsigned int end = size - 1 - words;
+            BITBOARD_WORDS_UNROLL
+            for (unsigned int i = begin; i < end; i++) {
+                res[i] = bits ? (a[i + words] >> bits) | (a[i + words + 1] << ((word_bits - bits) % word_bits)) : a[i + words];
+            }
+            res[end] = a[size - 1] >> bits;
+            BITBOARD_WORDS_UNROLL
+            for (unsigned int i = end + 1; i < size; i++) {
+                res[i] = 0;
+            }
+        }
+    };
+
+#ifdef BITBOARD_WORDS_X86
+    struct Avx2 {
+        static BITBOARD_WORDS_AVX2 __m256i load(const Word *src) {return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));}
+        static BITBOARD_WORDS_AVX2 void store(Word *dst, __m256i value) {_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), value);}
+
+        template <typename Op, unsigned int begin = 0>
+        static BITBOARD_WORDS_AVX2 void binary(Word *res, const Word *a, const Word *b) {
+            static constexpr unsigned int end = begin + (size - begin) / 4 * 4;
+            BITBOARD_WORDS_UNROLL
+            for (unsigned int i = begin; i < end; i += 4) {
+                store(res + i, Op::apply(load(a + i), load(b + i)));
+            }
+            Scalar::template binary<Op, end>(res, a, b);
+        }
+
+        template <unsigned int begin = 0>
+        static BITBOARD_WORDS_AVX2 void bit_not(Word *res, const Word *a) {
+            static constexpr unsigned int end = begin + (size - begin) / 4 * 4;
+            BITBOARD_WORDS_UNROLL
+            for (unsigned int i = begin; i < end; i += 4) {
+                store(res + i, _mm256_xor_si256(load(a + i), _mm256_set1_epi64x(-1)));
+            }
+            Scalar::template bit_not<end>(res, a);
+        }
+
+        template <unsigned int begin = 0>
+        static BITBOARD_WORDS_AVX2 bool any(const Word *a) {
+            static constexpr unsigned int end = begin + (size - begin) / 4 * 4;
+            BITBOARD_WORDS_UNROLL
+            for (unsigned int i = begin; i < end; i += 4) {
+                if (!_mm256_testz_si256(load(a + i), load(a + i))) {return true;}
+            }
+            return Scalar::template any<end>(a);
+        }
+
+        template <unsigned int begin = 0>
+        static BITBOARD_WORDS_AVX2 unsigned int count(const Word *a) {
+            return Scalar::template count<begin>(a);
+        }
+
+        template <unsigned int words, unsigned int bits, unsigned int begin = words + 1>
+        static BITBOARD_WORDS_AVX2 void shift_up(Word *res, const Word *a) {
+            static constexpr unsigned int end = bits ? begin + (size - begin) / 4 * 4 : begin;
+            BITBOARD_WORDS_UNROLL
+            for (unsigned int i = begin; i < end; i += 4) {
+                __m256i high = _mm256_slli_epi64(load(a + i - words), bits);
+                __m256i low = _mm256_srli_epi64(load(a + i - words - 1), (word_bits - bits) % word_bits);
+                store(res + i, _mm256_or_si256(high, low));
+            }
+            Scalar::template shift_up<words, bits, end>(res, a);
+        }
+
+        template <unsigned int words, unsigned int bits, unsigned int begin = 0>
+        static BITBOARD_WORDS_AVX2 void shift_down(Word *res, const Word *a) {
+            static constexpr unsigned int last = size - 1 - words;
+            static constexpr unsigned int end = bits ? begin + (last - begin) / 4 * 4 : begin;
+            BITBOARD_WORDS_UNROLL
+            for (unsigned int i = begin; i < end; i += 4) {
+                __m256i low = _mm256_srli_epi64(load(a + i + words), bits);
+                __m256i high = _mm256_slli_epi64(load(a + i + words + 1), (word_bits - bits) % word_bits);
+                store(res + i, _mm256_or_si256(low, high));
+            }
+            Scalar::template shift_down<words, bits, end>(res, a);
+        }
+    };
+
+    struct Avx512 {
+        static BITBOARD_WORDS_AVX512 __m512i load(const Word *src) {return _mm512_loadu_si512(src);}
+        static BITBOARD_WORDS_AVX512 void store(Word *dst, __m512i value) {_mm512_storeu_si512(dst, value);}
+
+        // The unmasked shifts trip a false -Wuninitialized in GCC 12's headers, and masking in every lane is the same instruction
+        static constexpr __mmask8 all_lanes = 0xFF;
+
+        template <typename Op, unsigned int begin = 0>
+        static BITBOARD_WORDS_AVX512 void binary(Word *res, const Word *a, const Word *b) {
+            static constexpr unsigned int end = begin + (size - begin) / 8 * 8;
+            BITBOARD_WORDS_UNROLL
+            for (unsigned int i = begin; i < end; i += 8) {
+                store(res + i, Op::apply(load(a + i), load(b + i)));
+            }
+            Avx2::template binary<Op, end>(res, a, b);
+        }
+
+        template <unsigned int begin = 0>
+        static BITBOARD_WORDS_AVX512 void bit_not(Word *res, const Word *a) {
+            static constexpr unsigned int end = begin + (size - begin) / 8 * 8;
+            BITBOARD_WORDS_UNROLL
+            for (unsigned int i = begin; i < end; i += 8) {
+                __m512i x = load(a + i);
+                store(res + i, _mm512_ternarylogic_epi64(x, x, x, 0x55));
+            }
+            Avx2::template bit_not<end>(res, a);
+        }
+
+        template <unsigned int begin = 0>
+        static BITBOARD_WORDS_AVX512 bool any(const Word *a) {
+            static constexpr unsigned int end = begin + (size - begin) / 8 * 8;
+            BITBOARD_WORDS_UNROLL
+            for (unsigned int i = begin; i < end; i += 8) {
+                __m512i x = load(a + i);
+                if (_mm512_test_epi64_mask(x, x)) {return true;}
+            }
+            return Avx2::template any<end>(a);
+        }
+
+        template <unsigned int begin = 0>
+        static BITBOARD_WORDS_AVX512 unsigned int count(const Word *a) {
+            return Scalar::template count<begin>(a);
+        }
+
+        template <unsigned int words, unsigned int bits, unsigned int begin = words + 1>
+        static BITBOARD_WORDS_AVX512 void shift_up(Word *res, const Word *a) {
+            static constexpr unsigned int end = bits ? begin + (size - begin) / 8 * 8 : begin;
+            BITBOARD_WORDS_UNROLL
+            for (unsigned int i = begin; i < end; i += 8) {
+                __m512i high = _mm512_maskz_slli_epi64(all_lanes, load(a + i - words), bits);
+                __m512i low = _mm512_maskz_srli_epi64(all_lanes, load(a + i - words - 1), (word_bits - bits) % word_bits);
+                store(res + i, _mm512_or_si512(high, low));
+            }
+            Avx2::template shift_up<words, bits, end>(res, a);
+        }
+
+        template <unsigned int words, unsigned int bits, unsigned int begin = 0>
+        static BITBOARD_WORDS_AVX512 void shift_down(Word *res, const Word *a) {
+            static constexpr unsigned int last = size - 1 - words;
+            static constexpr unsigned int end = bits ? begin + (last - begin) / 8 * 8 : begin;
+            BITBOARD_WORDS_UNROLL
+            for (unsigned int i = begin; i < end; i += 8) {
+                __m512i low = _mm512_maskz_srli_epi64(all_lanes, load(a + i + words), bits);
+                __m512i high = _mm512_maskz_slli_epi64(all_lanes, load(a + i + words + 1), (word_bits - bits) % word_bits);
+                store(res + i, _mm512_or_si512(low, high));
+            }
+            Avx2::template shift_down<words, bits, end>(res, a);
+        }
+    };
+
+    // Only the popcount differs, the rest is plain AVX-512
+    struct Avx512Popcnt : Avx512 {
+        template <unsigned int begin = 0>
+        static BITBOARD_WORDS_AVX512_POPCNT unsigned int count(const Word *a) {
+            static constexpr unsigned int end = begin + (size - begin) / 8 * 8;
+            __m512i sums = _mm512_setzero_si512();
+            BITBOARD_WORDS_UNROLL
+            for (unsigned int i = begin; i < end; i += 8) {
+                sums = _mm512_add_epi64(sums, _mm512_popcnt_epi64(Avx512::load(a + i)));
+            }
+
+            Word lanes[8];
+            Avx512::store(lanes, sums);
+            unsigned int res = 0;
+            BITBOARD_WORDS_UNROLL
+            for (unsigned int i = 0; i < 8; i++) {
+                res += lanes[i];
+            }
+            return res + Scalar::template count<end>(a);
+        }
+    };
+#endif
+
+    struct And {
+        static BITBOARD_WORDS_INLINE Word apply(Word x, Word y) {return x & y;}
+#ifdef BITBOARD_WORDS_X86
+        static BITBOARD_WORDS_AVX2 __m256i apply(__m256i x, __m256i y) {return _mm256_and_si256(x, y);}
+        static BITBOARD_WORDS_AVX512 __m512i apply(__m512i x, __m512i y) {return _mm512_and_si512(x, y);}
+#endif
+    };
+
+    struct Or {
+        static BITBOARD_WORDS_INLINE Word apply(Word x, Word y) {return x | y;}
+#ifdef BITBOARD_WORDS_X86
+        static BITBOARD_WORDS_AVX2 __m256i apply(__m256i x, __m256i y) {return _mm256_or_si256(x, y);}
+        static BITBOARD_WORDS_AVX512 __m512i apply(__m512i x, __m512i y) {return _mm512_or_si512(x, y);}
+#endif
+    };
+
+    struct Xor {
+        static BITBOARD_WORDS_INLINE Word apply(Word x, Word y) {return x ^ y;}
+#ifdef BITBOARD_WORDS_X86
+        static BITBOARD_WORDS_AVX2 __m256i apply(__m256i x, __m256i y) {return _mm256_xor_si256(x, y);}
+        static BITBOARD_WORDS_AVX512 __m512i apply(__m512i x, __m512i y) {return _mm512_xor_si512(x, y);}
+#endif
+    };
+};
+
+#undef BITBOARD_WORDS_DISPATCH
+
+#endif // BITBOARDSIMD_H
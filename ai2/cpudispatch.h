@@ -0,0 +1,72 @@
+#ifndef CPUDISPATCH_H
+#define CPUDISPATCH_H
+
+#include <string>
+
+// Picks which instruction set the vectorized BitBoard paths run on, once per process
+// Every path is compiled into the same binary with target attributes, so any build can run on any x86 CPU
+class CpuDispatch {
+public:
+    enum class Isa {Scalar, Avx2, Avx512, Avx512Popcnt};
+
+    // Starts as the best the CPU supports; a zero-initialized Scalar until then, so static initializers are safe too
+    static Isa get_active() {
+        return active;
+    }
+
+    // Only call this between searches, since every thread reads it without synchronization
+    static bool set_active(Isa isa) {
+        if (!is_supported(isa)) {return false;}
+        active = isa;
+        return true;
+    }
+
+    static Isa get_best() {
+        static const Isa candidates[] = {Isa::Avx512Popcnt, Isa::Avx512, Isa::Avx2};
+        for (Isa isa : candidates) {
+            if (is_supported(isa)) {return isa;}
+        }
+        return Isa::Scalar;
+    }
+
+    static bool is_supported(Isa isa) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        switch (isa) {
+            case Isa::Scalar: return true;
+            case Isa::Avx2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("popcnt");
+            case Isa::Avx512: return is_supported(Isa::Avx2) && __builtin_cpu_supports("avx512f");
+            case Isa::Avx512Popcnt: return is_supported(Isa::Avx512) && __builtin_cpu_supports("avx512vpopcntdq");
+        }
+        return false;
+#else
+        return isa == Isa::Scalar;
+#endif
+    }
+
+    static const char *get_name(Isa isa) {
+        switch (isa) {
+            case Isa::Scalar: return "scalar";
+            case Isa::Avx2: return "avx2";
+            case Isa::Avx512: return "avx512";
+            case Isa::Avx512Popcnt: return "avx512_vpopcnt";
+        }
+        return "";
+    }
+
+    static bool parse_name(const std::string &name, Isa &isa) {
+        static const Isa all[] = {Isa::Scalar, Isa::Avx2, Isa::Avx512, Isa::Avx512Popcnt};
+        for (Isa candidate : all) {
+            if (name == get_name(candidate)) {
+                isa = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    static Isa active;
+};
+
+#endif // CPUDISPATCH_H
@@ -0,0 +1,115 @@
+#ifndef EVALUATION_H
+#define EVALUATION_H
+
+// Static score for the side to move, with a piece of material worth MiniMaxShared::piece_value
+// Everything but material (which the board keeps up to date) is counted with bitboard ops here, and each term is
+// the side to move's count less the enemy's, so flipping the teams negates the score
+template <typename MiniMaxType>
+class Evaluation {
+public:
+    typedef typename MiniMaxType::Board Board;
+    typedef typename MiniMaxType::SizedBitBoard SizedBitBoard;
+
+    static constexpr unsigned int num_cells = MiniMaxType::num_cells;
+
+    static constexpr signed int piece_value = MiniMaxType::piece_value;
+
+    // A spawn is worth less than the piece it becomes, so spawning still gains something
+    static constexpr signed int spawn_value = 8;
+    // Per ready glider per direction, and again if its line ends on an enemy piece
+    static constexpr signed int glider_value = 2;
+    static constexpr signed int lane_value = 3;
+    // Per piece next to one of its side's kings
+    static constexpr signed int guard_value = 2;
+    // Per piece per ring around the enemy kings it's inside, out to pressure_rings, so closer pieces count more
+    static constexpr signed int pressure_value = 1;
+    static constexpr unsigned int pressure_rings = 3;
+
+    // Lazy evaluation skips the positional terms when material alone is this far outside the window
+    static constexpr signed int lazy_margin = 3 * piece_value;
+
+    static signed int evaluate(const Board &board) {
+        return calc_material_score(board) + calc_positional_score(board);
+    }
+
+    // Material that far outside (alpha, beta) is trusted to stay there, so the score is only exact inside the window
+    static signed int evaluate(const Board &board, signed int alpha, signed int beta) {
+        signed int res = calc_material_score(board);
+        if (res - lazy_margin >= beta || res + lazy_margin <= alpha) {return res;}
+        return res + calc_positional_score(board);
+    }
+
+    // The same with the positional terms worked out ahead of time, by EvaluationBatch
+    static signed int evaluate(const Board &board, signed int alpha, signed int beta, signed int positional) {
+        signed int res = calc_material_score(board);
+        if (res - lazy_margin >= beta || res + lazy_margin <= alpha) {return res;}
+        return res + positional;
+    }
+
+    static signed int calc_material_score(const Board &board) {
+        return board.calc_score() * piece_value
+            + (static_cast<signed int>(board.spawns[0]) - static_cast<signed int>(board.spawns[1])) * spawn_value;
+    }
+
+    static signed int calc_positional_score(const Board &board) {
+        const SizedBitBoard &own = board.teammates;
+        SizedBitBoard enemy = board.pieces & ~board.teammates;
+        signed int res = 0;
+
+        // The first ring around a side's kings has both its guards and the enemy pieces closest to them
+        SizedBitBoard own_zone = MiniMaxType::get_prox(board.get_own_kings());
+        SizedBitBoard enemy_zone = MiniMaxType::get_prox(board.get_enemy_kings());
+        SizedBitBoard guards = own & own_zone & ~board.kings;
+        SizedBitBoard enemy_guards = enemy & enemy_zone & ~board.kings;
+        res += (guards.count_set_bits() - enemy_guards.count_set_bits()) * guard_value;
+        res += (count_pressure(own, enemy_zone) - count_pressure(enemy, own_zone)) * pressure_value;
+
+        SizedBitBoard stops = ~board.empties;
+        res += score_gliders<0>(board, own, enemy, stops)
+            + score_gliders<1>(board, own, enemy, stops)
+            + score_gliders<2>(board, own, enemy, stops)
+            + score_gliders<3>(board, own, enemy, stops)
+            + score_gliders<4>(board, own, enemy, stops)
+            + score_gliders<5>(board, own, enemy, stops);
+        return res;
+    }
+
+private:
+    // zone starts as the first ring around the kings
+    static signed int count_pressure(const SizedBitBoard &side, SizedBitBoard zone) {
+        signed int res = (side & zone).count_set_bits();
+        for (unsigned int ring = 1; ring < pressure_rings; ring++) {
+            zone = MiniMaxType::get_prox(zone);
+            res += (side & zone).count_set_bits();
+        }
+        return res;
+    }
+
+    // Ours less theirs in one direction, with the same gliders as ActionGen::gen_glider_captures()
+    template <unsigned int dir>
+    static signed int score_gliders(const Board &board, const SizedBitBoard &own, const SizedBitBoard &enemy, const SizedBitBoard &stops) {
+        SizedBitBoard fronts = board.empties.template shift<MiniMaxType::dir_offsets[dir + 3]>();
+        return score_side<dir>(get_gliders<dir>(own, fronts), enemy, stops)
+            - score_side<dir>(get_gliders<dir>(enemy, fronts), own, stops);
+    }
+
+    template <unsigned int dir>
+    static SizedBitBoard get_gliders(const SizedBitBoard &side, const SizedBitBoard &fronts) {
+        return side & fronts
+            & side.template shift<MiniMaxType::dir_offsets[dir + 5]>()
+            & side.template shift<MiniMaxType::dir_offsets[dir + 1]>();
+    }
+
+    template <unsigned int dir>
+    static signed int score_side(SizedBitBoard gliders, const SizedBitBoard &targets, const SizedBitBoard &stops) {
+        signed int res = gliders.count_set_bits() * glider_value;
+        typename SizedBitBoard::FastBitEater i;
+        while (gliders.has_bit(i)) {
+            unsigned int blocker = MiniMaxType::find_blocker(stops, gliders.pop_bit(i), dir);
+            if (blocker < num_cells && targets.test(blocker)) {res += lane_value;}
+        }
+        return res;
+    }
+};
+
+#endif // EVALUATION_H
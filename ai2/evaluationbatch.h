@@ -0,0 +1,371 @@
+#ifndef EVALUATIONBATCH_H
+#define EVALUATIONBATCH_H
+
+#include <cstdint>
+#include <array>
+#include <type_traits>
+#include <assert.h>
+
+#include "cpudispatch.h"
+#include "actiongen.h"
+#include "evaluation.h"
+
+// The kernel gets an AVX2 copy whatever flags the rest of the build uses, picked at runtime like BitBoardWords
+#if defined(__x86_64__) || defined(__i386__)
+#define EVALUATION_BATCH_X86
+#define EVALUATION_BATCH_AVX2 __attribute__((target("avx2,popcnt")))
+#endif
+
+// Both copies inline every row op, so each becomes a loop the compiler can vectorize for its ISA
+#define EVALUATION_BATCH_INLINE inline __attribute__((always_inline))
+// Unrolling the loops over words leaves only the loops over boards, which -O2 vectorizes whole
+#define EVALUATION_BATCH_UNROLL _Pragma("GCC unroll 16")
+
+// Evaluation::calc_positional_score() for up to max_boards boards at once
+// Boards are stored structure-of-arrays: a row holds the same 64-bit word of a bitboard for every board, so each bitboard
+// op of the scalar terms becomes the same op across a row, which vectorizes over the boards
+// find_blocker() can't work per glider across a row, so every glider's flight is filled in at once, in a few steps of
+// doubling length; each lands where find_blocker() says, and no two land on the same cell, since the one behind stops at
+// the one in front
+template <typename MiniMaxType>
+class EvaluationBatch {
+public:
+    typedef typename MiniMaxType::Board Board;
+    typedef typename MiniMaxType::SizedBitBoard SizedBitBoard;
+    typedef Evaluation<MiniMaxType> Eval;
+
+    static constexpr unsigned int max_boards = 8;
+    static constexpr unsigned int num_words = SizedBitBoard::num_words64;
+
+    void clear() {
+        count = 0;
+    }
+
+    unsigned int size() const {
+        return count;
+    }
+
+    void add(const Board &board) {
+        assert(count < max_boards);
+        SizedBitBoard enemy = board.pieces & ~board.teammates;
+        SizedBitBoard own_kings = board.get_own_kings();
+        SizedBitBoard enemy_kings = board.get_enemy_kings();
+        for (unsigned int i = 0; i < num_words; i++) {
+            rows.own[i][count] = board.teammates.get_word64(i);
+            rows.enemy[i][count] = enemy.get_word64(i);
+            rows.empties[i][count] = board.empties.get_word64(i);
+            rows.own_kings[i][count] = own_kings.get_word64(i);
+            rows.enemy_kings[i][count] = enemy_kings.get_word64(i);
+        }
+        count++;
+    }
+
+    // The positional score of each board in the order they were added
+    // Every column is worked out, including ones left over from earlier batches, which cost the same and go unread
+    void calc_positional_scores(signed int *res) const {
+#ifdef EVALUATION_BATCH_X86
+        if (CpuDispatch::get_active() != CpuDispatch::Isa::Scalar) {
+            calc_avx2(rows, res, count);
+            return;
+        }
+#endif
+        calc_scalar(rows, res, count);
+    }
+
+    // Passes one board's score on to the next search code on this thread that scores a board with the same hash
+    static void hand_over(std::size_t hash, signed int score) {
+        get_pending() = Pending{hash, score, true};
+    }
+
+    static bool take_score(const Board &board, signed int &res) {
+        const Pending &pending = get_pending();
+        if (!pending.valid || pending.hash != board.hash) {return false;}
+        res = pending.score;
+        return true;
+    }
+
+private:
+    typedef std::array<std::array<std::uint64_t, max_boards>, num_words> Row;
+    typedef std::array<signed int, max_boards> Scores;
+
+    struct Rows {
+        Row own = {};
+        Row enemy = {};
+        Row empties = {};
+        Row own_kings = {};
+        Row enemy_kings = {};
+    };
+
+    struct Pending {
+        std::size_t hash;
+        signed int score;
+        bool valid;
+    };
+
+    Rows rows;
+    unsigned int count = 0;
+
+    static Pending &get_pending() {
+        static thread_local Pending pending = {0, 0, false};
+        return pending;
+    }
+
+    static void calc_scalar(const Rows &rows, signed int *res, unsigned int count) {
+        calc(rows, res, count);
+    }
+
+#ifdef EVALUATION_BATCH_X86
+    static EVALUATION_BATCH_AVX2 void calc_avx2(const Rows &rows, signed int *res, unsigned int count) {
+        calc(rows, res, count);
+    }
+#endif
+
+    // Evaluation::calc_positional_score() term for term
+    static EVALUATION_BATCH_INLINE void calc(const Rows &rows, signed int *res, unsigned int count) {
+        Scores scores = {};
+
+        Row kings = bit_or(rows.own_kings, rows.enemy_kings);
+        Row own_zone = get_prox(rows.own_kings);
+        Row enemy_zone = get_prox(rows.enemy_kings);
+        add_counts(scores, bit_and_not(bit_and(rows.own, own_zone), kings), Eval::guard_value);
+        add_counts(scores, bit_and_not(bit_and(rows.enemy, enemy_zone), kings), -Eval::guard_value);
+        add_pressure(scores, rows.own, enemy_zone, Eval::pressure_value);
+        add_pressure(scores, rows.enemy, own_zone, -Eval::pressure_value);
+
+        add_gliders<0>(scores, rows);
+        add_gliders<1>(scores, rows);
+        add_gliders<2>(scores, rows);
+        add_gliders<3>(scores, rows);
+        add_gliders<4>(scores, rows);
+        add_gliders<5>(scores, rows);
+
+        for (unsigned int j = 0; j < count; j++) {
+            res[j] = scores[j];
+        }
+    }
+
+    static EVALUATION_BATCH_INLINE void add_pressure(Scores &scores, const Row &side, Row zone, signed int value) {
+        add_counts(scores, bit_and(side, zone), value);
+        for (unsigned int ring = 1; ring < Eval::pressure_rings; ring++) {
+            zone = get_prox(zone);
+            add_counts(scores, bit_and(side, zone), value);
+        }
+    }
+
+    template <unsigned int dir>
+    static EVALUATION_BATCH_INLINE void add_gliders(Scores &scores, const Rows &rows) {
+        Row fronts = shift<MiniMaxType::dir_offsets[dir + 3]>(rows.empties);
+        Row own_gliders = get_gliders<dir>(rows.own, fronts);
+        Row enemy_gliders = get_gliders<dir>(rows.enemy, fronts);
+        add_counts(scores, own_gliders, Eval::glider_value);
+        add_counts(scores, enemy_gliders, -Eval::glider_value);
+        add_counts(scores, bit_and(land<dir>(own_gliders, rows.empties), rows.enemy), Eval::lane_value);
+        add_counts(scores, bit_and(land<dir>(enemy_gliders, rows.empties), rows.own), -Eval::lane_value);
+    }
+
+    template <unsigned int dir>
+    static EVALUATION_BATCH_INLINE Row get_gliders(const Row &side, const Row &fronts) {
+        return bit_and(bit_and(side, fronts), bit_and(shift<MiniMaxType::dir_offsets[dir + 5]>(side), shift<MiniMaxType::dir_offsets[dir + 1]>(side)));
+    }
+
+    // The first cell that isn't empty along dir from each glider, which is off the board if the flight leaves it
+    template <unsigned int dir>
+    static EVALUATION_BATCH_INLINE Row land(const Row &gliders, const Row &empties) {
+        static constexpr signed int offset = MiniMaxType::dir_offsets[dir];
+        Row flown = gliders;
+        fill<offset, 1>(flown, empties, std::false_type());
+        return bit_and_not(shift<offset>(flown), empties);
+    }
+
+    // Spreads cells along offset over open cells, doubling the reach each step, until it covers any line on the board
+    // Once the step with reach r is done, cells has everything up to 2r - 1 open cells along from where it started
+    template <signed int offset, unsigned int reach>
+    static EVALUATION_BATCH_INLINE void fill(Row &cells, Row open, std::false_type) {
+        static constexpr signed int distance = offset * static_cast<signed int>(reach);
+        cells = bit_or(cells, bit_and(open, shift<distance>(cells)));
+        open = bit_and(open, shift<distance>(open));
+        fill<offset, reach * 2>(cells, open, std::integral_constant<bool, reach * 2 - 1 >= MiniMaxType::board_diam>());
+    }
+
+    template <signed int offset, unsigned int reach>
+    static EVALUATION_BATCH_INLINE void fill(Row &cells, Row open, std::true_type) {}
+
+    static EVALUATION_BATCH_INLINE Row get_prox(const Row &cells) {
+        Row res = cells;
+        res = bit_or(res, shift<MiniMaxType::dir_offsets[0]>(cells));
+        res = bit_or(res, shift<MiniMaxType::dir_offsets[1]>(cells));
+        res = bit_or(res, shift<MiniMaxType::dir_offsets[2]>(cells));
+        res = bit_or(res, shift<MiniMaxType::dir_offsets[3]>(cells));
+        res = bit_or(res, shift<MiniMaxType::dir_offsets[4]>(cells));
+        res = bit_or(res, shift<MiniMaxType::dir_offsets[5]>(cells));
+        return res;
+    }
+
+    // Like BitBoard's shift, words carry into each other and bits past either end are lost
+    template <signed int offset>
+    static EVALUATION_BATCH_INLINE Row shift(const Row &a) {
+        static constexpr unsigned int distance = offset > 0 ? offset : -offset;
+        static constexpr unsigned int words = distance / 64;
+        static constexpr unsigned int bits = distance % 64;
+        static_assert(distance > 0, "Rows can't shift by nothing");
+
+        // The same split as BitBoardWords: one end word, then the words made of two source words each
+        Row res = {};
+        if (words >= num_words) {return res;}
+        if (offset > 0) {
+            for (unsigned int j = 0; j < max_boards; j++) {
+                res[words][j] = a[0][j] << bits;
+            }
+            EVALUATION_BATCH_UNROLL
+            for (unsigned int i = words + 1; i < num_words; i++) {
+                for (unsigned int j = 0; j < max_boards; j++) {
+                    res[i][j] = bits ? (a[i - words][j] << bits) | (a[i - words - 1][j] >> ((64 - bits) % 64)) : a[i - words][j];
+                }
+            }
+        } else {
+            EVALUATION_BATCH_UNROLL
+            for (unsigned int i = 0; i + words + 1 < num_words; i++) {
+                for (unsigned int j = 0; j < max_boards; j++) {
+                    res[i][j] = bits ? (a[i + words][j] >> bits) | (a[i + words + 1][j] << ((64 - bits) % 64)) : a[i + words][j];
+                }
+            }
+            for (unsigned int j = 0; j < max_boards; j++) {
+                res[num_words - 1 - words][j] = a[num_words - 1][j] >> bits;
+            }
+        }
+        return res;
+    }
+
+    static EVALUATION_BATCH_INLINE Row bit_and(const Row &a, const Row &b) {
+        Row res;
+        EVALUATION_BATCH_UNROLL
+        for (unsigned int i = 0; i < num_words; i++) {
+            for (unsigned int j = 0; j < max_boards; j++) {
+                res[i][j] = a[i][j] & b[i][j];
+            }
+        }
+        return res;
+    }
+
+    static EVALUATION_BATCH_INLINE Row bit_and_not(const Row &a, const Row &b) {
+        Row res;
+        EVALUATION_BATCH_UNROLL
+        for (unsigned int i = 0; i < num_words; i++) {
+            for (unsigned int j = 0; j < max_boards; j++) {
+                res[i][j] = a[i][j] & ~b[i][j];
+            }
+        }
+        return res;
+    }
+
+    static EVALUATION_BATCH_INLINE Row bit_or(const Row &a, const Row &b) {
+        Row res;
+        EVALUATION_BATCH_UNROLL
+        for (unsigned int i = 0; i < num_words; i++) {
+            for (unsigned int j = 0; j < max_boards; j++) {
+                res[i][j] = a[i][j] | b[i][j];
+            }
+        }
+        return res;
+    }
+
+    static EVALUATION_BATCH_INLINE void add_counts(Scores &scores, const Row &a, signed int value) {
+        EVALUATION_BATCH_UNROLL
+        for (unsigned int i = 0; i < num_words; i++) {
+            for (unsigned int j = 0; j < max_boards; j++) {
+                scores[j] += __builtin_popcountll(a[i][j]) * value;
+            }
+        }
+    }
+};
+
+// ActionGen for a node one ply above the horizon, which makes its children ahead of searching them, max_boards at a
+// time, so EvaluationBatch can score them together
+// The actions come out in the same order with the same stage and exchange; each one's positional score is handed to
+// the child's quiescence through EvaluationBatch::hand_over()
+template <typename MiniMaxType, typename TurnState>
+class BatchedActionGen {
+public:
+    typedef typename MiniMaxType::Board Board;
+    typedef ActionGen<MiniMaxType, TurnState> Gen;
+    typedef typename Gen::Stage Stage;
+
+    static constexpr unsigned int max_boards = EvaluationBatch<MiniMaxType>::max_boards;
+
+    BatchedActionGen(const Board &board, Action table_action, const MoveOrder<MiniMaxType::num_cells> *move_order, unsigned int ply)
+        : board(board)
+        , gen(board, table_action, move_order, ply)
+    {}
+
+    bool next(Action &action) {
+        if (index == count && !refill()) {return false;}
+
+        const Entry &entry = entries[index];
+        action = entry.action;
+        stage = entry.stage;
+        exchange = entry.exchange;
+        EvaluationBatch<MiniMaxType>::hand_over(entry.hash, scores[index]);
+        index++;
+        return true;
+    }
+
+    bool found_win() const {
+        return gen.found_win();
+    }
+
+    Action get_win_action() const {
+        return gen.get_win_action();
+    }
+
+    Stage get_stage() const {
+        return stage;
+    }
+
+    signed int get_exchange() const {
+        assert(is_capture_stage(stage));
+        return exchange;
+    }
+
+private:
+    struct Entry {
+        Action action;
+        Stage stage;
+        signed int exchange;
+        std::size_t hash;
+    };
+
+    const Board &board;
+    Gen gen;
+    EvaluationBatch<MiniMaxType> batch;
+    std::array<Entry, max_boards> entries;
+    std::array<signed int, max_boards> scores;
+    unsigned int count = 0;
+    unsigned int index = 0;
+    Stage stage = Stage::Start;
+    signed int exchange = 0;
+
+    static bool is_capture_stage(Stage stage) {
+        return stage == Stage::KingCaptures || stage == Stage::GliderCaptures;
+    }
+
+    bool refill() {
+        count = 0;
+        index = 0;
+        batch.clear();
+
+        Action action;
+        while (count < max_boards && gen.next(action)) {
+            Stage action_stage = gen.get_stage();
+            Board child = board.apply(action).template flip_teams<Board>();
+            entries[count] = Entry{action, action_stage, is_capture_stage(action_stage) ? gen.get_exchange() : 0, child.hash};
+            batch.add(child);
+            count++;
+        }
+        if (!count) {return false;}
+
+        batch.calc_positional_scores(scores.data());
+        return true;
+    }
+};
+
+#endif // EVALUATIONBATCH_H
@@ -0,0 +1,430 @@
+#ifndef GAMEBOARD_H
+#define GAMEBOARD_H
+
+#include <cstdint>
+#include <array>
+#include <string>
+#include <utility>
+#include <assert.h>
+
+#include "bitboard.h"
+#include "actionlog.h"
+#include "zobrist.h"
+#include "network.h"
+
+// A position seen from the side to move, which is team 0 in teammates and spawns
+// Kings are a bitboard for both sides, split by teammates like pieces, since formations can give a side several;
+// a side is out once it has none left
+// Material is kept up to date by every transition rather than counted, since only jumps and spawns change it
+// Children come either as fresh copies (move, jump, glide, spawn, flip_teams) or by changing this board in place
+// and undoing it afterwards (make, unmake, flip), which skips copying every bitboard per child
+// Either way, a board with a NetworkAccumulator passes the child the next one along, changed by the action's features only
+template <unsigned int board_rad>
+class GameBoard {
+public:
+    static constexpr unsigned int board_radius = board_rad;
+    static constexpr unsigned int board_diam = board_rad * 2 + 1;
+    static constexpr unsigned int board_width = board_diam + 1;
+    static constexpr unsigned int board_height = board_diam;
+    static constexpr unsigned int num_cells = board_width * board_height;
+
+    static_assert(num_cells <= 512, "Action::pack() has 9 bits per cell, which a radius 10 board just fits in");
+
+    typedef BitBoard<num_cells> SizedBitBoard;
+    typedef Zobrist<num_cells> SizedZobrist;
+
+    // What make() can't work out again from the action alone
+    struct Undo {
+        std::uint32_t action;
+        bool moved_king;
+        bool took_king;
+        unsigned int spawns;
+        std::size_t hash;
+        NetworkAccumulator *accumulator;
+    };
+
+    GameBoard() {}
+
+    GameBoard(
+        SizedBitBoard empties,
+        SizedBitBoard pieces,
+        SizedBitBoard teammates,
+        SizedBitBoard kings,
+        std::array<unsigned int, 2> spawns,
+        unsigned int side = 0
+    )
+        : empties(empties)
+        , pieces(pieces)
+        , teammates(teammates)
+        , kings(kings)
+        , spawns(spawns)
+        , side(side)
+    {
+        material = calc_material();
+        hash = calc_hash();
+    }
+
+    GameBoard(
+        SizedBitBoard empties,
+        SizedBitBoard pieces,
+        SizedBitBoard teammates,
+        SizedBitBoard kings,
+        std::array<unsigned int, 2> spawns,
+        unsigned int side,
+        signed int material,
+        std::size_t hash
+    )
+        : empties(empties)
+        , pieces(pieces)
+        , teammates(teammates)
+        , kings(kings)
+        , spawns(spawns)
+        , side(side)
+        , material(material)
+        , hash(hash)
+    {}
+
+    SizedBitBoard empties;
+    SizedBitBoard pieces;
+    SizedBitBoard teammates;
+    SizedBitBoard kings;
+    std::array<unsigned int, 2> spawns;
+
+    // Absolute side to move, since teammates/spawns are relative to it
+    unsigned int side;
+
+    // Our pieces less theirs, which fits in front of hash without making the board any bigger
+    // Call calc_material() after setting the fields by hand
+    signed int material;
+
+    // Zobrist key, kept up to date by every transition
+    // Call calc_hash() after setting the fields by hand
+    std::size_t hash;
+
+    // The network's first layer for this board, if a search gave it one (see NetworkEval)
+    NetworkAccumulator *accumulator = 0;
+
+    SizedBitBoard get_own_kings() const {return kings & teammates;}
+    SizedBitBoard get_enemy_kings() const {return kings & ~teammates;}
+
+    bool operator==(const GameBoard &other) const {
+        return pieces == other.pieces && teammates == other.teammates && kings == other.kings && spawns == other.spawns && side == other.side;
+    }
+
+    // Building the child straight from XORs beats copying the board and changing the copy, which costs a second pass over the words
+    GameBoard move(unsigned int src, unsigned int dst) const {
+        assert(!empties.test(src));
+        assert(teammates.test(src));
+        assert(pieces.test(src));
+        assert(empties.test(dst));
+        assert(!teammates.test(dst));
+        assert(!pieces.test(dst));
+
+        const SizedZobrist &keys = SizedZobrist::keys;
+        SizedBitBoard flip = SizedBitBoard::from_bits(src, dst);
+        GameBoard res = GameBoard(empties ^ flip, pieces ^ flip, teammates ^ flip, kings, spawns, side, material, hash ^ keys.piece(side, src) ^ keys.piece(side, dst));
+        if (kings.test(src)) {res.kings ^= flip; res.hash ^= keys.king(side, src) ^ keys.king(side, dst);}
+        if (accumulator) {res.accumulator = push_accumulator(); track_move(src, dst, res.accumulator);}
+
+        return res;
+    }
+
+    GameBoard jump(unsigned int src, unsigned int dst) const {
+        assert(!empties.test(src));
+        assert(teammates.test(src));
+        assert(pieces.test(src));
+        assert(!empties.test(dst));
+        assert(!teammates.test(dst));
+        assert(pieces.test(dst));
+
+        const SizedZobrist &keys = SizedZobrist::keys;
+        SizedBitBoard flip_1 = SizedBitBoard::from_bits(src);
+        SizedBitBoard flip_2 = SizedBitBoard::from_bits(src, dst);
+        GameBoard res = GameBoard(empties ^ flip_1, pieces ^ flip_1, teammates ^ flip_2, kings, spawns, side, material + 1, hash ^ keys.piece(side, src) ^ keys.piece(side ^ 1, dst) ^ keys.piece(side, dst));
+        if (kings.test(dst)) {res.kings ^= SizedBitBoard::from_bits(dst); res.hash ^= keys.king(side ^ 1, dst);}
+        if (kings.test(src)) {
+            res.kings ^= flip_2;
+            res.spawns[0]++;
+            res.hash ^= keys.king(side, src) ^ keys.king(side, dst) ^ keys.spawns(side, spawns[0]) ^ keys.spawns(side, res.spawns[0]);
+        }
+        if (accumulator) {res.accumulator = push_accumulator(); track_jump(src, dst, res.accumulator);}
+
+        return res;
+    }
+
+    GameBoard glide(unsigned int src, unsigned int dst) const {
+        assert(!empties.test(src));
+        assert(teammates.test(src));
+        assert(pieces.test(src));
+        assert(empties.test(dst));
+        assert(!teammates.test(dst));
+        assert(!pieces.test(dst));
+
+        const SizedZobrist &keys = SizedZobrist::keys;
+        SizedBitBoard flip = SizedBitBoard::from_bits(src, dst);
+        GameBoard res = GameBoard(empties ^ flip, pieces ^ flip, teammates ^ flip, kings, spawns, side, material, hash ^ keys.piece(side, src) ^ keys.piece(side, dst));
+        if (kings.test(src)) {res.kings ^= flip; res.hash ^= keys.king(side, src) ^ keys.king(side, dst);}
+        if (accumulator) {res.accumulator = push_accumulator(); track_move(src, dst, res.accumulator);}
+
+        return res;
+    }
+
+    GameBoard spawn(unsigned int dst) const {
+        assert(empties.test(dst));
+        assert(!teammates.test(dst));
+        assert(!pieces.test(dst));
+
+        const SizedZobrist &keys = SizedZobrist::keys;
+        SizedBitBoard flip = SizedBitBoard::from_bits(dst);
+        std::size_t res_hash = hash ^ keys.piece(side, dst) ^ keys.spawns(side, spawns[0]) ^ keys.spawns(side, spawns[0] - 1);
+        GameBoard res = GameBoard(empties ^ flip, pieces ^ flip, teammates ^ flip, kings, {spawns[0] - 1, spawns[1]}, side, material + 1, res_hash);
+        if (accumulator) {res.accumulator = push_accumulator(); track_spawn(dst, res.accumulator);}
+
+        return res;
+    }
+
+    // The accumulator is by absolute player, so passing the turn shares it
+    template <typename BoardType>
+    BoardType flip_teams() const {
+        BoardType res(empties, pieces, pieces ^ teammates, kings, {spawns[1], spawns[0]}, side ^ 1, -material, hash ^ SizedZobrist::keys.side_to_move());
+        res.accumulator = accumulator;
+        return res;
+    }
+
+    GameBoard apply(const Action &action) const {
+        switch (action.type) {
+            case ActionType::Move: return move(action.src, action.dst);
+            case ActionType::Jump: return jump(action.src, action.dst);
+            case ActionType::Glide: return glide(action.src, action.dst);
+            case ActionType::Spawn: return spawn(action.dst);
+            default: assert(false); return *this;
+        }
+    }
+
+    // Applies the action to this board, returning what unmake() needs to take it back
+    Undo make(const Action &action) {
+        bool moved_king = action.type != ActionType::Spawn && kings.test(action.src);
+        bool took_king = action.type == ActionType::Jump && kings.test(action.dst);
+        Undo undo = {action.pack(), moved_king, took_king, spawns[0], hash, accumulator};
+        if (accumulator) {
+            NetworkAccumulator *child = push_accumulator();
+            switch (action.type) {
+                case ActionType::Move: track_move(action.src, action.dst, child); break;
+                case ActionType::Jump: track_jump(action.src, action.dst, child); break;
+                case ActionType::Glide: track_move(action.src, action.dst, child); break;
+                case ActionType::Spawn: track_spawn(action.dst, child); break;
+                default: assert(false); break;
+            }
+            accumulator = child;
+        }
+        switch (action.type) {
+            case ActionType::Move: make_move(action.src, action.dst); break;
+            case ActionType::Jump: make_jump(action.src, action.dst); break;
+            case ActionType::Glide: make_move(action.src, action.dst); break;
+            case ActionType::Spawn: make_spawn(action.dst); break;
+            default: assert(false); break;
+        }
+        return undo;
+    }
+
+    // Undoes the last make() that hasn't been undone yet; the bits it changed are toggled back rather than saved
+    // The parent's accumulator was left as it was, like the hash, so going back to it is enough
+    void unmake(const Undo &undo) {
+        Action action = Action::unpack(undo.action);
+        switch (action.type) {
+            case ActionType::Move: toggle_move(action.src, action.dst); break;
+            case ActionType::Jump: toggle_jump(action.src, action.dst); material--; break;
+            case ActionType::Glide: toggle_move(action.src, action.dst); break;
+            case ActionType::Spawn: toggle_cell(action.dst); material--; break;
+            default: assert(false); break;
+        }
+
+        if (undo.took_king) {kings.toggle_bit(action.dst);}
+        if (undo.moved_king) {kings.toggle_bit(action.src); kings.toggle_bit(action.dst);}
+        spawns[0] = undo.spawns;
+        hash = undo.hash;
+        accumulator = undo.accumulator;
+    }
+
+    // flip_teams() in place; it undoes itself
+    void flip() {
+        teammates ^= pieces;
+        std::swap(spawns[0], spawns[1]);
+        side ^= 1;
+        material = -material;
+        hash ^= SizedZobrist::keys.side_to_move();
+    }
+
+    signed int calc_score() const {
+        return material;
+    }
+
+    signed int calc_material() const {
+        return teammates.count_set_bits() * 2 - pieces.count_set_bits();
+    }
+
+    std::size_t calc_hash() const {
+        const SizedZobrist &keys = SizedZobrist::keys;
+
+        std::size_t res = side ? keys.side_to_move() : 0;
+
+        SizedBitBoard remaining = pieces;
+        typename SizedBitBoard::FastBitEater i;
+        while (remaining.has_bit(i)) {
+            unsigned int pos = remaining.pop_bit(i);
+            res ^= keys.piece(teammates.test(pos) ? side : side ^ 1, pos);
+        }
+
+        SizedBitBoard remaining_kings = kings;
+        typename SizedBitBoard::FastBitEater j;
+        while (remaining_kings.has_bit(j)) {
+            unsigned int pos = remaining_kings.pop_bit(j);
+            res ^= keys.king(teammates.test(pos) ? side : side ^ 1, pos);
+        }
+
+        res ^= keys.spawns(side, spawns[0]) ^ keys.spawns(side ^ 1, spawns[1]);
+        return res;
+    }
+
+    std::string to_string() const {
+        std::string res;
+
+        for (unsigned int i = 0; i < num_cells; i++) {
+            unsigned int row = i / board_width;
+            unsigned int col = i % board_width;
+
+            if (col == 0) {
+                for (unsigned int j = 0; j < row; j++) {
+                    res += ' ';
+                }
+
+                res += '0' + (i / 100) % 10;
+                res += '0' + (i / 10) % 10;
+                res += '0' + (i / 1) % 10;
+                res += ' ';
+            }
+
+            if (kings.test(i)) {
+                if (teammates.test(i)) {res += 'O';}
+                else {res += 'X';}
+            }
+            else if (pieces.test(i)) {
+                if (teammates.test(i)) {res += 'o';}
+                else {res += 'x';}
+            }
+            else if (empties.test(i)) {res += '+';}
+            else {res += '.';}
+
+            res += ' ';
+
+            if (col == board_width - 1) {
+                res += '\n';
+            }
+        }
+
+        res += "O spn " + std::to_string(spawns[0]) + "\n";
+        res += "X spn " + std::to_string(spawns[1]) + "\n";
+
+        return res;
+    }
+
+private:
+    // A copy of this board's accumulator in the slot after it, or none once the stack runs out
+    NetworkAccumulator *push_accumulator() const {
+        if (accumulator->last) {return 0;}
+        accumulator[1] = accumulator[0];
+        return accumulator + 1;
+    }
+
+    // Each action's feature changes, from this board before it; glides change the same ones as moves
+    void track_move(unsigned int src, unsigned int dst, NetworkAccumulator *acc) const {
+        if (!acc) {return;}
+        acc->move_piece(kings.test(src), side, Network::get_max_cell<board_rad>(src), Network::get_max_cell<board_rad>(dst));
+    }
+
+    void track_jump(unsigned int src, unsigned int dst, NetworkAccumulator *acc) const {
+        if (!acc) {return;}
+        acc->remove_piece(kings.test(dst), side ^ 1, Network::get_max_cell<board_rad>(dst));
+        acc->move_piece(kings.test(src), side, Network::get_max_cell<board_rad>(src), Network::get_max_cell<board_rad>(dst));
+        if (kings.test(src)) {acc->change_spawns(side, spawns[0], spawns[0] + 1);}
+    }
+
+    void track_spawn(unsigned int dst, NetworkAccumulator *acc) const {
+        if (!acc) {return;}
+        acc->add_piece(false, side, Network::get_max_cell<board_rad>(dst));
+        acc->change_spawns(side, spawns[0], spawns[0] - 1);
+    }
+
+    // Glides change the board just like moves
+    void make_move(unsigned int src, unsigned int dst) {
+        assert(!empties.test(src));
+        assert(teammates.test(src));
+        assert(pieces.test(src));
+        assert(empties.test(dst));
+        assert(!teammates.test(dst));
+        assert(!pieces.test(dst));
+
+        const SizedZobrist &keys = SizedZobrist::keys;
+        toggle_move(src, dst);
+        hash ^= keys.piece(side, src) ^ keys.piece(side, dst);
+        if (kings.test(src)) {
+            kings.toggle_bit(src);
+            kings.toggle_bit(dst);
+            hash ^= keys.king(side, src) ^ keys.king(side, dst);
+        }
+    }
+
+    void make_jump(unsigned int src, unsigned int dst) {
+        assert(!empties.test(src));
+        assert(teammates.test(src));
+        assert(pieces.test(src));
+        assert(!empties.test(dst));
+        assert(!teammates.test(dst));
+        assert(pieces.test(dst));
+
+        const SizedZobrist &keys = SizedZobrist::keys;
+        toggle_jump(src, dst);
+        material++;
+        hash ^= keys.piece(side, src) ^ keys.piece(side ^ 1, dst) ^ keys.piece(side, dst);
+        if (kings.test(dst)) {kings.toggle_bit(dst); hash ^= keys.king(side ^ 1, dst);}
+        if (kings.test(src)) {
+            kings.toggle_bit(src);
+            kings.toggle_bit(dst);
+            spawns[0]++;
+            hash ^= keys.king(side, src) ^ keys.king(side, dst) ^ keys.spawns(side, spawns[0] - 1) ^ keys.spawns(side, spawns[0]);
+        }
+    }
+
+    void make_spawn(unsigned int dst) {
+        assert(empties.test(dst));
+        assert(!teammates.test(dst));
+        assert(!pieces.test(dst));
+
+        const SizedZobrist &keys = SizedZobrist::keys;
+        toggle_cell(dst);
+        material++;
+        hash ^= keys.piece(side, dst) ^ keys.spawns(side, spawns[0]) ^ keys.spawns(side, spawns[0] - 1);
+        spawns[0]--;
+    }
+
+    // The bitboard half of each action, which is its own inverse
+    void toggle_cell(unsigned int pos) {
+        empties.toggle_bit(pos);
+        pieces.toggle_bit(pos);
+        teammates.toggle_bit(pos);
+    }
+
+    void toggle_move(unsigned int src, unsigned int dst) {
+        toggle_cell(src);
+        toggle_cell(dst);
+    }
+
+    void toggle_jump(unsigned int src, unsigned int dst) {
+        empties.toggle_bit(src);
+        pieces.toggle_bit(src);
+        teammates.toggle_bit(src);
+        teammates.toggle_bit(dst);
+    }
+};
+
+#endif // GAMEBOARD_H
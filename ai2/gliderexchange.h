@@ -0,0 +1,92 @@
+#ifndef GLIDEREXCHANGE_H
+#define GLIDEREXCHANGE_H
+
+#include <array>
+#include <algorithm>
+#include <assert.h>
+
+#include "actionlog.h"
+
+// Static exchange evaluation for captures
+// Plays out the recaptures on the landing cell, each side using gliders before its king,
+// and lets either side stop recapturing when that's better for it
+template <typename MiniMaxType>
+class GliderExchange {
+public:
+    typedef typename MiniMaxType::Board Board;
+    typedef typename MiniMaxType::SizedBitBoard SizedBitBoard;
+
+    static constexpr unsigned int num_cells = MiniMaxType::num_cells;
+
+    static constexpr signed int piece_value = 1;
+    static constexpr signed int king_value = 100;
+    static constexpr unsigned int max_swaps = 8;
+
+    // Net material for the side to move, in pieces, if it makes this capture
+    static signed int evaluate(const Board &board, const Action &capture) {
+        assert(capture.type == ActionType::Jump);
+
+        const unsigned int target = capture.dst;
+
+        std::array<signed int, max_swaps + 1> gain;
+        gain[0] = get_value(board.get_enemy_kings(), target);
+        if (gain[0] == king_value) {return king_value;}
+
+        // Only material counts here, so the swaps leave the network's accumulators alone
+        Board cur = board;
+        cur.accumulator = 0;
+
+        signed int on_target = get_value(board.get_own_kings(), capture.src);
+        cur = cur.apply(capture).template flip_teams<Board>();
+
+        unsigned int depth = 0;
+        unsigned int attacker;
+        while (depth < max_swaps && find_attacker(cur, target, attacker)) {
+            depth++;
+            gain[depth] = on_target - gain[depth - 1];
+
+            // Taking a king ends the game, so nothing comes after it
+            if (on_target == king_value) {break;}
+
+            on_target = get_value(cur.get_own_kings(), attacker);
+            cur = cur.jump(attacker, target).template flip_teams<Board>();
+        }
+
+        while (depth > 0) {
+            gain[depth - 1] = -std::max(-gain[depth - 1], gain[depth]);
+            depth--;
+        }
+
+        return gain[0];
+    }
+
+    // Only a side's last king is worth the game; while it has others, losing one costs a piece
+    static signed int get_value(const SizedBitBoard &kings, unsigned int pos) {
+        return kings == SizedBitBoard::from_bits(pos) ? king_value : piece_value;
+    }
+
+    // Finds a piece of the side to move that can capture on target, preferring a glider to a king
+    // Any piece next to an enemy king can take it
+    static bool find_attacker(const Board &board, unsigned int target, unsigned int &attacker) {
+        SizedBitBoard stops = ~board.empties;
+        for (unsigned int dir = 0; dir < 6; dir++) {
+            // Look backwards from the target to the first piece
+            unsigned int pos = MiniMaxType::find_blocker(stops, target, (dir + 3) % 6);
+            if (pos < num_cells && MiniMaxType::is_glider(board, pos, dir)) {
+                attacker = pos;
+                return true;
+            }
+        }
+
+        SizedBitBoard jumpers = MiniMaxType::get_prox(target) & (board.kings.test(target) ? board.teammates : board.get_own_kings());
+        typename SizedBitBoard::FastBitEater i;
+        if (jumpers.has_bit(i)) {
+            attacker = jumpers.pop_bit(i);
+            return true;
+        }
+
+        return false;
+    }
+};
+
+#endif // GLIDEREXCHANGE_H
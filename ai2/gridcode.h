@@ -0,0 +1,280 @@
+#ifndef GRIDCODE_H
+#define GRIDCODE_H
+
+#include <string>
+#include <array>
+#include <cctype>
+#include <cstdlib>
+#include <assert.h>
+
+// Reads the web game's board and formation codes (see src/hexgrid.js)
+// A code is the radius and the number of sectors, in base 36, and then one cell type per cell of the first sector:
+// the center, then each ring outwards, and then the same again for every other sector.
+// The game's board radius counts the edge ring, so a radius 5 board is a MiniMax<4> board.
+
+// The parts of reading a code that don't depend on the board size
+class HexGrid {
+public:
+    static std::string clean_code(const std::string &code) {
+        std::string res;
+        for (char c : code) {
+            if (std::isalnum(static_cast<unsigned char>(c)) || c == '_') {
+                res += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+        }
+        return res;
+    }
+
+    static unsigned int parse_digit(char c, unsigned int fallback) {
+        if (c >= '0' && c <= '9') {return c - '0';}
+        if (c >= 'a' && c <= 'z') {return c - 'a' + 10;}
+        return fallback;
+    }
+
+    // Radius and sectors of a cleaned code, with the same defaults as the web game
+    static bool read_header(const std::string &clean, unsigned int &radius, unsigned int &sectors, std::string &error) {
+        radius = clean.size() > 0 ? parse_digit(clean[0], 5) : 5;
+        sectors = clean.size() > 1 ? parse_digit(clean[1], 1) : 1;
+
+        if (radius < 2) {
+            error = "Radius " + std::to_string(radius) + " is invalid, must be at least 2";
+            return false;
+        }
+        if (sectors == 0 || 6 % sectors != 0) {
+            error = "The number of sectors (" + std::to_string(sectors) + ") is invalid, must be a divisor of 6";
+            return false;
+        }
+        return true;
+    }
+
+    // How many steps a cell is from the center
+    static unsigned int get_ring(signed int row, signed int col) {
+        unsigned int res = std::abs(row);
+        if (static_cast<unsigned int>(std::abs(col)) > res) {res = std::abs(col);}
+        if (static_cast<unsigned int>(std::abs(row + col)) > res) {res = std::abs(row + col);}
+        return res;
+    }
+
+    // Board cells are 'n', 'v' or missing, or walls ('w')
+    // game.js's add_cell makes all but walls empty cells, despite 'v' meaning void in its type_map
+    // Nothing can stand on or pass through a wall, so walls come out the same as the edge of the board
+    static bool is_board_type(char type) {
+        return type == 0 || type == 'n' || type == 'v' || type == 'w';
+    }
+
+    static bool is_playable(char type) {
+        return type != 'w';
+    }
+
+    // The smallest MiniMax radius that holds every playable cell of a board code
+    static bool get_fit_radius(const std::string &board_code, unsigned int &board_rad, std::string &error) {
+        std::string clean = clean_code(board_code);
+        unsigned int radius;
+        unsigned int sectors;
+        if (!read_header(clean, radius, sectors, error)) {return false;}
+
+        bool ok = true;
+        board_rad = 0;
+        for_each_cell(clean, radius, sectors, [&](signed int row, signed int col, char type, unsigned int) {
+            if (!is_board_type(type)) {
+                if (ok) {error = std::string("Invalid type code \"") + type + "\"";}
+                ok = false;
+            } else if (is_playable(type) && get_ring(row, col) > board_rad) {
+                board_rad = get_ring(row, col);
+            }
+        });
+        return ok;
+    }
+
+    // Same walk as str_to_grid in src/hexgrid.js, which is why the coordinates look the way they do
+    // Cells past the end of the code get type 0; sectors must divide 6
+    template <typename Callback>
+    static void for_each_cell(const std::string &code, unsigned int radius, unsigned int sectors, Callback callback) {
+        unsigned int i = 2;
+        signed int x = 0;
+        signed int y = 0;
+        unsigned int s = 0;
+        assert(6 % sectors == 0);
+        while (true) {
+            char type = i < code.size() ? code[i] : 0;
+
+            // The six rotations of the first sector, shared out so each player gets 6 / sectors of them
+            // Player p's part of sector s is rotation s + p * sectors, which puts two players in opposite corners
+            // and three players two corners apart
+            for (unsigned int player = 0; player < 6 / sectors; player++) {
+                switch (s + player * sectors) {
+                    case 0: callback(x, y - x, type, player); break;
+                    case 1: callback(y, -x, type, player); break;
+                    case 2: callback(y - x, -y, type, player); break;
+                    case 3: callback(-x, x - y, type, player); break;
+                    case 4: callback(-y, x, type, player); break;
+                    case 5: callback(x - y, y, type, player); break;
+                }
+            }
+
+            i++;
+            x++;
+            if (x >= y) {
+                x = 0;
+                y++;
+                if (y >= static_cast<signed int>(radius)) {
+                    y = 0;
+                    s++;
+                    if (s >= sectors) {break;}
+                }
+            }
+        }
+    }
+};
+
+template <typename MiniMaxType>
+class GridCode {
+public:
+    typedef typename MiniMaxType::Board Board;
+    typedef typename MiniMaxType::SizedBitBoard SizedBitBoard;
+
+    static constexpr signed int board_rad = MiniMaxType::board_radius;
+
+    // The playable cells of a board code
+    // Returns false and sets error if the code is invalid or has a playable cell outside this board
+    static bool load_board(const std::string &code, SizedBitBoard &cells, std::string &error) {
+        std::string clean = HexGrid::clean_code(code);
+        unsigned int radius;
+        unsigned int sectors;
+        if (!HexGrid::read_header(clean, radius, sectors, error)) {return false;}
+
+        cells = SizedBitBoard::from_bits();
+        bool ok = true;
+        HexGrid::for_each_cell(clean, radius, sectors, [&](signed int row, signed int col, char type, unsigned int) {
+            if (!ok) {return;}
+            if (!HexGrid::is_board_type(type)) {
+                error = std::string("Invalid type code \"") + type + "\"";
+                ok = false;
+                return;
+            }
+            if (!HexGrid::is_playable(type)) {return;}
+
+            if (!is_inside(row, col)) {
+                error = "Board cell " + std::to_string(row) + "," + std::to_string(col) + " is outside a radius " + std::to_string(board_rad + 1) + " board";
+                ok = false;
+                return;
+            }
+            cells |= SizedBitBoard::from_bits(MiniMaxType::lookup_cell_id(row + board_rad, col + board_rad));
+        });
+        return ok;
+    }
+
+    // Sets up a two player game on an empty board, with sector 0 to move
+    // Returns false and sets error if the code can't be played on this board
+    static bool load_formation(const std::string &code, unsigned int spawns, Board &board, std::string &error) {
+        return load_formation(code, spawns, get_cells(), board, error);
+    }
+
+    // Same on a board from load_board()
+    static bool load_formation(const std::string &code, unsigned int spawns, const SizedBitBoard &cells, Board &board, std::string &error) {
+        std::array<SizedBitBoard, 2> teams;
+        std::array<SizedBitBoard, 2> kings;
+        if (!load_players(code, cells, teams, kings, error)) {return false;}
+
+        SizedBitBoard pieces = teams[0] | teams[1];
+        board = Board(cells & ~pieces, pieces, teams[0], kings[0] | kings[1], {{spawns, spawns}}, 0);
+        return true;
+    }
+
+    // Same for three or six players (MultiMiniMax boards), with player 0 to move
+    static bool load_multi_formation(const std::string &code, unsigned int spawns, const SizedBitBoard &cells, Board &board, std::string &error) {
+        static constexpr unsigned int num_players = std::tuple_size<decltype(Board::players)>::value;
+
+        std::array<SizedBitBoard, num_players> players;
+        std::array<SizedBitBoard, num_players> kings;
+        if (!load_players(code, cells, players, kings, error)) {return false;}
+
+        SizedBitBoard pieces = SizedBitBoard::from_bits();
+        SizedBitBoard all_kings = SizedBitBoard::from_bits();
+        for (unsigned int player = 0; player < num_players; player++) {
+            pieces |= players[player];
+            all_kings |= kings[player];
+        }
+
+        std::array<unsigned int, num_players> all_spawns;
+        all_spawns.fill(spawns);
+        board = Board(cells & ~pieces, players, all_kings, all_spawns, 0);
+        return true;
+    }
+
+    // Every cell of a full hexagonal board
+    static SizedBitBoard get_cells() {
+        SizedBitBoard res = SizedBitBoard::from_bits();
+        for (signed int row = -board_rad; row <= board_rad; row++) {
+            for (signed int col = -board_rad; col <= board_rad; col++) {
+                if (row + col >= -board_rad && row + col <= board_rad) {
+                    res |= SizedBitBoard::from_bits(MiniMaxType::lookup_cell_id(row + board_rad, col + board_rad));
+                }
+            }
+        }
+        return res;
+    }
+
+private:
+    static bool is_inside(signed int row, signed int col) {
+        return HexGrid::get_ring(row, col) <= static_cast<unsigned int>(board_rad);
+    }
+
+    // Each player's pieces and kings, checking that the code is for this many players and that every piece is on one of cells
+    template <std::size_t num_players>
+    static bool load_players(const std::string &code, const SizedBitBoard &cells, std::array<SizedBitBoard, num_players> &players, std::array<SizedBitBoard, num_players> &kings, std::string &error) {
+        std::string clean = HexGrid::clean_code(code);
+        unsigned int radius;
+        unsigned int sectors;
+        if (!HexGrid::read_header(clean, radius, sectors, error)) {return false;}
+
+        if (sectors * num_players != 6) {
+            error = "A " + std::to_string(num_players) + " player game needs a formation with " + std::to_string(6 / num_players) + " sectors";
+            return false;
+        }
+
+        players.fill(SizedBitBoard::from_bits());
+        kings.fill(SizedBitBoard::from_bits());
+        SizedBitBoard pieces = SizedBitBoard::from_bits();
+
+        bool ok = true;
+        HexGrid::for_each_cell(clean, radius, sectors, [&](signed int row, signed int col, char type, unsigned int player) {
+            if (!ok || type == 'e' || type == 0) {return;}
+            if (type != 'n' && type != 'k') {
+                error = std::string("Invalid type code \"") + type + "\"";
+                ok = false;
+                return;
+            }
+
+            if (!is_inside(row, col) || !cells.test(MiniMaxType::lookup_cell_id(row + board_rad, col + board_rad))) {
+                error = "Piece at " + std::to_string(row) + "," + std::to_string(col) + " is off the board";
+                ok = false;
+                return;
+            }
+            unsigned int cell = MiniMaxType::lookup_cell_id(row + board_rad, col + board_rad);
+            if (pieces.test(cell)) {
+                error = "Piece location " + std::to_string(cell) + " is already occupied";
+                ok = false;
+                return;
+            }
+
+            pieces |= SizedBitBoard::from_bits(cell);
+            players[player] |= SizedBitBoard::from_bits(cell);
+            if (type == 'k') {
+                kings[player] |= SizedBitBoard::from_bits(cell);
+            }
+        });
+        if (!ok) {return false;}
+
+        for (const SizedBitBoard &player_kings : kings) {
+            if (!player_kings.has_bit()) {
+                error = "Every player needs a king";
+                return false;
+            }
+        }
+
+        return true;
+    }
+};
+
+#endif // GRIDCODE_H
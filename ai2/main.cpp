@@ -1,17 +1,26 @@
 #include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
 
 #include "turnstate.h"
 #include "minimax.h"
+#include "multiminimax.h"
+#include "gridcode.h"
+#include "perft.h"
+#include "position.h"
+#include "cpudispatch.h"
 
 /*
 Search good moves first - gliders, captures
-Iterative deepening
-Transposition table
-Killer move
 Quiescence search
 */
 
 typedef MiniMax<4, true> Algorithm;
+typedef Perft<MiniMax<4, false>> AlgorithmPerft;
+typedef PositionCode<Algorithm> AlgorithmPositionCode;
+typedef MultiPerft<MultiMiniMax<4, 2>> AlgorithmPerft2;
+typedef MultiPerft<MultiMiniMax<4, 3>> AlgorithmPerft3;
 
 template <unsigned int times>
 void dilate(Algorithm::SizedBitBoard &bit_board) {
@@ -22,19 +31,431 @@ void dilate(Algorithm::SizedBitBoard &bit_board) {
     }
 }
 
+template <typename PerftType>
+void print_counts(const typename PerftType::Counts &counts) {
+    std::cout << "turns " << counts.turns;
+    for (unsigned int i = 1; i < PerftType::num_types; i++) {
+        std::cout << ' ' << Action::get_type_name(static_cast<ActionType>(i)) << ' ' << counts.actions[i];
+    }
+    std::cout << " wins " << counts.wins << std::endl;
+}
+
+template <unsigned int board_rad>
+void run_perft(const GameBoard<board_rad> &root, unsigned int depth, bool divide) {
+    typedef Perft<MiniMax<board_rad, false>> PerftType;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    typename PerftType::Counts total;
+    std::vector<typename PerftType::Divide> entries = PerftType::divide(root, depth, MiniMaxShared::num_threads, total);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (divide) {
+        for (const typename PerftType::Divide &entry : entries) {
+            std::cout << entry.action.to_string() << ": " << entry.counts.turns << std::endl;
+        }
+    }
+
+    print_counts<PerftType>(total);
+    std::cerr << "time " << static_cast<unsigned long long>(secs * 1000)
+              << " turns/s " << static_cast<unsigned long long>(secs > 0 ? total.turns / secs : 0) << std::endl;
+}
+
+// Returns whether every reference count still matches
+// MultiMiniMax's generator is checked too, against the two player counts with two players, and its own with three
+bool run_perft_check() {
+    bool ok = true;
+    for (const AlgorithmPerft::Reference &ref : AlgorithmPerft::get_references()) {
+        Algorithm::Board board;
+        std::string error;
+        if (!GridCode<Algorithm>::load_formation(ref.formation, ref.spawns, board, error)) {
+            std::cerr << ref.name << ": " << error << std::endl;
+            ok = false;
+            continue;
+        }
+
+        AlgorithmPerft::Counts counts;
+        AlgorithmPerft::divide(board, ref.depth, MiniMaxShared::num_threads, counts);
+
+        bool match = counts.turns == ref.turns;
+        ok &= match;
+        std::cout << (match ? "ok   " : "FAIL ") << ref.name << " depth " << ref.depth
+                  << " expected " << ref.turns << " got " << counts.turns << std::endl;
+
+        // Every count, not just turns, at the depths that stay quick without threads
+        if (ref.depth > 3) {continue;}
+        AlgorithmPerft2::Board multi_board;
+        if (!GridCode<MultiMiniMax<4, 2>>::load_multi_formation(ref.formation, ref.spawns, GridCode<Algorithm>::get_cells(), multi_board, error)) {
+            std::cerr << ref.name << ": " << error << std::endl;
+            ok = false;
+            continue;
+        }
+
+        AlgorithmPerft2::Counts multi_counts = AlgorithmPerft2::count(multi_board, ref.depth);
+        match = multi_counts == counts;
+        ok &= match;
+        std::cout << (match ? "ok   " : "FAIL ") << ref.name << " depth " << ref.depth
+                  << " two players expected " << counts.turns << " got " << multi_counts.turns << std::endl;
+    }
+
+    for (const AlgorithmPerft3::Reference &ref : AlgorithmPerft3::get_references()) {
+        AlgorithmPerft3::Board board;
+        std::string error;
+        if (!GridCode<MultiMiniMax<4, 3>>::load_multi_formation(ref.formation, ref.spawns, GridCode<Algorithm>::get_cells(), board, error)) {
+            std::cerr << ref.name << ": " << error << std::endl;
+            ok = false;
+            continue;
+        }
+
+        AlgorithmPerft3::Counts counts = AlgorithmPerft3::count(board, ref.depth);
+        bool match = counts.turns == ref.turns;
+        ok &= match;
+        std::cout << (match ? "ok   " : "FAIL ") << ref.name << " depth " << ref.depth
+                  << " three players expected " << ref.turns << " got " << counts.turns << std::endl;
+    }
+    return ok;
+}
+
+// Searches every position in the file, one report line per position and a summary line, all as key=value pairs
+// A position counts as solved from the first iteration after which every iteration found the expected result
+bool run_suite(const std::string &path, unsigned int max_depth, unsigned int time_ms) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Can't open " << path << std::endl;
+        return false;
+    }
+
+    unsigned int num_positions = 0;
+    unsigned int num_solved = 0;
+    unsigned long long total_ms = 0;
+    unsigned long long total_nodes = 0;
+
+    std::string line;
+    unsigned int line_num = 0;
+    while (std::getline(file, line)) {
+        line_num++;
+        if (line.empty() || line[0] == '#') {continue;}
+
+        AlgorithmPositionCode::Position pos;
+        std::string error;
+        if (!AlgorithmPositionCode::parse(line, pos, error)) {
+            std::cerr << path << ":" << line_num << ": " << error << std::endl;
+            return false;
+        }
+        if (pos.id.empty()) {pos.id = "line" + std::to_string(line_num);}
+
+        // Each position starts cold, so results don't depend on the order of the suite
+        MiniMaxShared::transposition_table.clear();
+        MiniMaxShared::get_move_order<Algorithm::num_cells>().clear();
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        Algorithm::SearchResult res = Algorithm::search(pos.board, max_depth, time_ms);
+        unsigned long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+        const Algorithm::Iteration *solved_at = 0;
+        for (const Algorithm::Iteration &iteration : res.iterations) {
+            if (!pos.matches(iteration.score, iteration.action)) {solved_at = 0;}
+            else if (!solved_at) {solved_at = &iteration;}
+        }
+        bool solved = pos.has_expectation() && solved_at;
+
+        num_positions++;
+        num_solved += solved;
+        total_ms += ms;
+        total_nodes += res.nodes;
+
+        std::cout << "position id=" << pos.id
+                  << " solved=" << solved
+                  << " depth=" << res.depth
+                  << " score=" << res.score
+                  << " action=" << Action::get_type_name(res.pv.get_first_action().type)
+                  << ',' << res.pv.get_first_action().src
+                  << ',' << res.pv.get_first_action().dst
+                  << " solve_depth=" << (solved ? solved_at->depth : 0)
+                  << " solve_ms=" << (solved ? solved_at->ms : 0)
+                  << " solve_nodes=" << (solved ? solved_at->nodes : 0)
+                  << " ms=" << ms
+                  << " nodes=" << res.nodes
+                  << " nps=" << (ms ? res.nodes * 1000 / ms : 0) << std::endl;
+    }
+
+    std::cout << "suite positions=" << num_positions
+              << " solved=" << num_solved
+              << " ms=" << total_ms
+              << " nodes=" << total_nodes
+              << " nps=" << (total_ms ? total_nodes * 1000 / total_ms : 0) << std::endl;
+    return true;
+}
+
+// What a game from the command line needs besides its board, so it can be handed to whichever board size fits
+struct GameOptions {
+    std::string board = "5";
+    std::string formation;
+    unsigned int spawns = 0;
+    unsigned int num_players = 2;
+    bool maxn = false;
+    unsigned int max_depth = 0;
+    unsigned int time_ms = 0;
+    unsigned int perft_depth = 0;
+    bool divide = false;
+};
+
+// Three and six player games only come from formations
+template <unsigned int board_rad, unsigned int num_players>
+bool run_multi(const typename GameBoard<board_rad>::SizedBitBoard &cells, const GameOptions &opts) {
+    typedef MultiMiniMax<board_rad, num_players> MultiAlgorithm;
+
+    typename MultiAlgorithm::Board board;
+    std::string error;
+    if (!GridCode<MultiAlgorithm>::load_multi_formation(opts.formation, opts.spawns, cells, board, error)) {
+        std::cerr << "Bad formation: " << error << std::endl;
+        return false;
+    }
+
+    std::cout << board.to_string() << std::endl;
+
+    if (opts.perft_depth) {
+        print_counts<MultiPerft<MultiAlgorithm>>(MultiPerft<MultiAlgorithm>::count(board, opts.perft_depth));
+        return true;
+    }
+
+    typename MultiAlgorithm::Mode mode = opts.maxn ? MultiAlgorithm::Mode::MaxN : MultiAlgorithm::Mode::Paranoid;
+    typename MultiAlgorithm::SearchResult res = MultiAlgorithm::search(board, mode, opts.max_depth, opts.time_ms);
+    std::cout << res.action.to_string() << std::endl;
+
+    std::cout << "scores";
+    for (signed int score : res.scores) {
+        std::cout << " " << score;
+    }
+    std::cout << std::endl;
+
+    std::cerr << "depth " << res.depth << std::endl;
+    std::cerr << "nodes " << res.nodes << std::endl;
+    return true;
+}
+
+// Perft or a search from a two player position, with the search's stats
+template <unsigned int board_rad>
+int run_game(const GameBoard<board_rad> &board, const GameOptions &opts) {
+    typedef MiniMax<board_rad, true> AlgorithmType;
+
+    std::cout << "isa " << CpuDispatch::get_name(CpuDispatch::get_active()) << std::endl;
+    std::cout << board.to_string() << std::endl;
+    std::cout << PositionCode<AlgorithmType>::to_code(board) << std::endl;
+
+    if (opts.perft_depth) {
+        run_perft(board, opts.perft_depth, opts.divide);
+        return 0;
+    }
+
+    typename AlgorithmType::SearchResult res = AlgorithmType::search(board, opts.max_depth, opts.time_ms);
+    std::cout << res.score << std::endl;
+    std::cout << res.pv.to_string() << std::endl;
+
+    std::cerr << "nodes " << res.nodes << std::endl;
+
+    TranspositionTable::Stats tt_stats = MiniMaxShared::transposition_table.get_stats();
+    std::cerr << "tt hits " << tt_stats.hits
+              << " misses " << tt_stats.misses
+              << " collisions " << tt_stats.collisions
+              << " overwrites " << tt_stats.overwrites << std::endl;
+
+    return 0;
+}
+
+// Sets up the board and formation codes on a board of this size and plays them
+template <unsigned int board_rad>
+int run_codes(const GameOptions &opts) {
+    typedef MiniMax<board_rad, true> AlgorithmType;
+
+    typename AlgorithmType::SizedBitBoard cells;
+    std::string error;
+    if (!GridCode<AlgorithmType>::load_board(opts.board, cells, error)) {
+        std::cerr << "Bad board: " << error << std::endl;
+        return 1;
+    }
+
+    switch (opts.num_players) {
+        case 2: break;
+        case 3: return run_multi<board_rad, 3>(cells, opts) ? 0 : 1;
+        case 6: return run_multi<board_rad, 6>(cells, opts) ? 0 : 1;
+        default:
+            std::cerr << "Games have 2, 3 or 6 players" << std::endl;
+            return 1;
+    }
+
+    typename AlgorithmType::Board board;
+    if (!GridCode<AlgorithmType>::load_formation(opts.formation, opts.spawns, cells, board, error)) {
+        std::cerr << "Bad formation: " << error << std::endl;
+        return 1;
+    }
+
+    return run_game(board, opts);
+}
+
+// Picks the smallest board size minimax.cpp has compiled that holds the board code, since the search needs it at compile time
+int run_board_code(const GameOptions &opts) {
+    unsigned int board_rad;
+    std::string error;
+    if (!HexGrid::get_fit_radius(opts.board, board_rad, error)) {
+        std::cerr << "Bad board: " << error << std::endl;
+        return 1;
+    }
+
+    switch (board_rad) {
+        case 0: case 1: case 2:
+        case 3: return run_codes<3>(opts);
+        case 4: return run_codes<4>(opts);
+        case 5: return run_codes<5>(opts);
+        case 6: return run_codes<6>(opts);
+        case 7: return run_codes<7>(opts);
+        case 8: return run_codes<8>(opts);
+        case 9: return run_codes<9>(opts);
+        case 10: return run_codes<10>(opts);
+        default:
+            std::cerr << "Bad board: radius " << board_rad + 1 << " is bigger than the largest supported board, radius 11" << std::endl;
+            return 1;
+    }
+}
+
 int main(int argc, char **argv) {
+    GameOptions opts;
+    std::string position;
+    std::string suite;
+    std::string network;
+    std::string write_network;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--hash-mb" && i + 1 < argc) {
+            MiniMaxShared::transposition_table.resize(std::stoul(argv[++i]));
+        } else if (arg == "--threads" && i + 1 < argc) {
+            MiniMaxShared::num_threads = std::stoul(argv[++i]);
+        } else if (arg == "--depth" && i + 1 < argc) {
+            opts.max_depth = std::stoul(argv[++i]);
+        } else if (arg == "--time-ms" && i + 1 < argc) {
+            opts.time_ms = std::stoul(argv[++i]);
+        } else if (arg == "--nodes" && i + 1 < argc) {
+            MiniMaxShared::max_nodes = std::stoull(argv[++i]);
+        } else if (arg == "--no-positional") {
+            MiniMaxShared::use_positional = false;
+        } else if (arg == "--network" && i + 1 < argc) {
+            network = argv[++i];
+        } else if (arg == "--write-network" && i + 1 < argc) {
+            write_network = argv[++i];
+        } else if (arg == "--no-move-order") {
+            MiniMaxShared::use_move_order = false;
+        } else if (arg == "--no-pvs") {
+            MiniMaxShared::use_pvs = false;
+        } else if (arg == "--no-aspiration") {
+            MiniMaxShared::use_aspiration = false;
+        } else if (arg == "--no-null-move") {
+            MiniMaxShared::use_null_move = false;
+        } else if (arg == "--no-lmr") {
+            MiniMaxShared::use_lmr = false;
+        } else if (arg == "--no-futility") {
+            MiniMaxShared::use_futility = false;
+        } else if (arg == "--batch-eval") {
+            MiniMaxShared::use_batch_eval = true;
+        } else if (arg == "--make-mode" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "auto") {MiniMaxShared::make_mode = MiniMaxShared::MakeMode::Auto;}
+            else if (mode == "copy") {MiniMaxShared::make_mode = MiniMaxShared::MakeMode::Copy;}
+            else if (mode == "in-place") {MiniMaxShared::make_mode = MiniMaxShared::MakeMode::InPlace;}
+            else {
+                std::cerr << "Unknown make mode: " << mode << std::endl;
+                return 1;
+            }
+        } else if (arg == "--formation" && i + 1 < argc) {
+            opts.formation = argv[++i];
+        } else if (arg == "--board" && i + 1 < argc) {
+            opts.board = argv[++i];
+        } else if (arg == "--players" && i + 1 < argc) {
+            opts.num_players = std::stoul(argv[++i]);
+        } else if (arg == "--multi-mode" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "paranoid") {opts.maxn = false;}
+            else if (mode == "maxn") {opts.maxn = true;}
+            else {
+                std::cerr << "Unknown multi-player mode: " << mode << std::endl;
+                return 1;
+            }
+        } else if (arg == "--position" && i + 1 < argc) {
+            position = argv[++i];
+        } else if (arg == "--suite" && i + 1 < argc) {
+            suite = argv[++i];
+        } else if (arg == "--spawns" && i + 1 < argc) {
+            opts.spawns = std::stoul(argv[++i]);
+        } else if (arg == "--perft" && i + 1 < argc) {
+            opts.perft_depth = std::stoul(argv[++i]);
+        } else if (arg == "--divide") {
+            opts.divide = true;
+        } else if (arg == "--isa" && i + 1 < argc) {
+            CpuDispatch::Isa isa;
+            if (!CpuDispatch::parse_name(argv[++i], isa)) {
+                std::cerr << "Unknown instruction set: " << argv[i] << std::endl;
+                return 1;
+            }
+            if (!CpuDispatch::set_active(isa)) {
+                std::cerr << "The CPU doesn't support " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--perft-check") {
+            return run_perft_check() ? 0 : 1;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    // A network that scores material, to start training from or to check the network path with
+    if (!write_network.empty()) {
+        std::string error;
+        if (!Network::make_material(MiniMaxShared::piece_value).save(write_network, error)) {
+            std::cerr << "Bad network: " << error << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (!network.empty()) {
+        std::string error;
+        if (!MiniMaxShared::network.load(network, error)) {
+            std::cerr << "Bad network: " << error << std::endl;
+            return 1;
+        }
+        MiniMaxShared::use_network = true;
+    }
+
+    if (opts.max_depth == 0) {
+        opts.max_depth = opts.time_ms || MiniMaxShared::max_nodes ? TranspositionTable::max_depth : 2;
+    }
+
+    if (!suite.empty()) {
+        return run_suite(suite, opts.max_depth, opts.time_ms) ? 0 : 1;
+    }
+
+    if (opts.num_players != 2 && opts.formation.empty()) {
+        std::cerr << "More than two players needs --formation" << std::endl;
+        return 1;
+    }
+
+    // Formations can be on any board the web game makes
+    if (!opts.formation.empty() && (position.empty() || opts.num_players != 2)) {
+        return run_board_code(opts);
+    }
+
     Algorithm::Board board;
 
-    board.kings = {Algorithm::lookup_cell_id(8, 2), Algorithm::lookup_cell_id(1, 7)};
+    board.kings = Algorithm::SizedBitBoard::from_bits(Algorithm::lookup_cell_id(8, 2), Algorithm::lookup_cell_id(1, 7));
     board.spawns = {2, 2};
 
     board.teammates = Algorithm::SizedBitBoard::from_bits(
-                board.kings[0],
+                Algorithm::lookup_cell_id(8, 2),
                 Algorithm::lookup_cell_id(7, 2),
                 Algorithm::lookup_cell_id(7, 1));
 
     board.pieces = board.teammates | Algorithm::SizedBitBoard::from_bits(
-                board.kings[1],
+                Algorithm::lookup_cell_id(1, 7),
                 Algorithm::lookup_cell_id(2, 5),
                 Algorithm::lookup_cell_id(3, 3));
 
@@ -42,12 +463,19 @@ int main(int argc, char **argv) {
     dilate<4>(board.empties);
     board.empties &= ~board.pieces;
 
-    std::cout << board.to_string() << std::endl;
+    board.side = 0;
+    board.material = board.calc_material();
+    board.hash = board.calc_hash();
 
-    Algorithm alg(3);
-    signed int score = alg.calc_score(board);
-    std::cout << score << std::endl;
-    std::cout << alg.to_string() << std::endl;
+    if (!position.empty()) {
+        AlgorithmPositionCode::Position pos;
+        std::string error;
+        if (!AlgorithmPositionCode::parse(position, pos, error)) {
+            std::cerr << "Bad position: " << error << std::endl;
+            return 1;
+        }
+        board = pos.board;
+    }
 
-    return 0;
+    return run_game(board, opts);
 }
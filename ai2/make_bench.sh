@@ -0,0 +1,3 @@
+#!/bin/sh
+
+g++ -std=c++14 -O2 -DNDEBUG -Wfatal-errors -pthread bench.cpp minimax.cpp -o ai2_bench
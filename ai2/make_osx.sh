@@ -1,3 +1,3 @@
 #!/bin/sh
 
-g++ -std=c++1y -stdlib=libc++ -g -O0 -Wfatal-errors main.cpp minimax.cpp -o ai2
+g++ -std=c++1y -stdlib=libc++ -g -O0 -Wfatal-errors -pthread main.cpp minimax.cpp -o ai2
@@ -0,0 +1,3 @@
+#!/bin/sh
+
+g++ -std=c++14 -g -O0 -Wfatal-errors -pthread test.cpp minimax.cpp -o ai2_test
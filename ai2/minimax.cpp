@@ -1,13 +1,39 @@
 #include "minimax.h"
 
-template <unsigned int board_rad, bool save_actions>
-constexpr signed int MiniMax<board_rad, save_actions>::dir_offsets[];
+CpuDispatch::Isa CpuDispatch::active = CpuDispatch::get_best();
 
-template <unsigned int board_rad, bool save_actions>
-std::unordered_map<
-	typename MiniMax<board_rad, save_actions>::Board,
-	typename MiniMax<board_rad, save_actions>::CacheScore,
-	typename MiniMax<board_rad, save_actions>::Board::Hasher
-> MiniMax<board_rad, save_actions>::cache;
+TranspositionTable MiniMaxShared::transposition_table;
+std::atomic<bool> MiniMaxShared::stop;
+MiniMaxShared::Clock::time_point MiniMaxShared::deadline = MiniMaxShared::Clock::time_point::max();
+unsigned long long MiniMaxShared::node_limit = std::numeric_limits<unsigned long long>::max();
+thread_local bool MiniMaxShared::main_thread = false;
+thread_local unsigned long long MiniMaxShared::nodes;
+std::atomic<unsigned long long> MiniMaxShared::total_nodes;
+thread_local TranspositionTable::Stats MiniMaxShared::tt_stats;
+thread_local PvTable MiniMaxShared::pv_table;
+unsigned long long MiniMaxShared::max_nodes = 0;
+unsigned int MiniMaxShared::num_threads = 1;
+bool MiniMaxShared::use_positional = true;
+Network MiniMaxShared::network;
+bool MiniMaxShared::use_network = false;
+bool MiniMaxShared::use_batch_eval = false;
+bool MiniMaxShared::use_move_order = true;
+bool MiniMaxShared::use_pvs = true;
+bool MiniMaxShared::use_aspiration = true;
+bool MiniMaxShared::use_null_move = true;
+bool MiniMaxShared::use_lmr = true;
+bool MiniMaxShared::use_futility = true;
+MiniMaxShared::MakeMode MiniMaxShared::make_mode = MiniMaxShared::MakeMode::Auto;
 
-template class MiniMax<4, true>;
\ No newline at end of file
+// std::min() takes it by reference, so it needs a definition without optimization folding it away
+constexpr signed int Network::max_activation;
+
+// Every board size main.cpp can pick for a board code, see the extern declarations in minimax.h
+template class MiniMax<3, true>;
+template class MiniMax<4, true>;
+template class MiniMax<5, true>;
+template class MiniMax<6, true>;
+template class MiniMax<7, true>;
+template class MiniMax<8, true>;
+template class MiniMax<9, true>;
+template class MiniMax<10, true>;
@@ -6,26 +6,162 @@
 #include <type_traits>
 #include <array>
 #include <string>
-#include <unordered_map>
-
-#include "bitboard.h"
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <thread>
+#include <functional>
+#include <limits>
+
+#include "gameboard.h"
 #include "turnstate.h"
 #include "actionlog.h"
+#include "pvtable.h"
+#include "zobrist.h"
+#include "transpositiontable.h"
+#include "moveorder.h"
+#include "actiongen.h"
+#include "evaluation.h"
+#include "evaluationbatch.h"
+#include "network.h"
 
 #include "jw_util/hash.h"
 
+// State shared by every board size and every node of a search
+class MiniMaxShared {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    static TranspositionTable transposition_table;
+
+    // Checked by every node; set it to unwind the current search
+    static std::atomic<bool> stop;
+    // Only the main thread reads the deadline and node limit, the helpers just follow stop
+    static Clock::time_point deadline;
+    static unsigned long long node_limit;
+    static thread_local bool main_thread;
+
+    // Each thread counts its own nodes, and adds them to the total every deadline check
+    static thread_local unsigned long long nodes;
+    static std::atomic<unsigned long long> total_nodes;
+    static thread_local TranspositionTable::Stats tt_stats;
+
+    static constexpr unsigned long long deadline_check_interval = 4096;
+
+    // Stops the search once this many nodes have been searched, if set
+    static unsigned long long max_nodes;
+
+    // Threads searching the same root, sharing only the transposition table
+    static unsigned int num_threads;
+
+    // Scores count this much per piece of material, leaving room for Evaluation's positional terms in between
+    static constexpr signed int piece_value = 16;
+    // Score with Evaluation rather than material alone
+    static bool use_positional;
+    // Score with network instead, once main.cpp has loaded one
+    static Network network;
+    static bool use_network;
+    // Work out the positional terms of a frontier node's children together, with EvaluationBatch
+    static bool use_batch_eval;
+
+    // Order actions by killers and history rather than by generation order
+    static bool use_move_order;
+    // Search every turn after the first with a null window, re-searching the ones that beat alpha
+    static bool use_pvs;
+    // Start each iteration with a window around the last score, widening it when the score falls outside
+    static bool use_aspiration;
+
+    static constexpr signed int aspiration_window = piece_value;
+
+    // Let the opponent move twice and cut off if we're still above beta
+    static bool use_null_move;
+    // Search quiet turns late in the ordering to a reduced depth first
+    static bool use_lmr;
+    // Skip quiet turns, or the whole node, near the leaves when the material is too far below alpha
+    static bool use_futility;
+
+    // Whether children get a copy of the board each, or the node changes its own board and undoes it afterwards
+    // Auto picks whichever bench.cpp measured faster for the board size
+    enum class MakeMode {Auto, Copy, InPlace};
+    static MakeMode make_mode;
+
+    // Each thread builds its own principal variation
+    static thread_local PvTable pv_table;
+
+    template <unsigned int num_cells>
+    static MoveOrder<num_cells> &get_move_order() {
+        static thread_local MoveOrder<num_cells> move_order;
+        return move_order;
+    }
+
+protected:
+    static void count_node() {
+        nodes++;
+        if (nodes % deadline_check_interval == 0) {
+            unsigned long long total = total_nodes.fetch_add(deadline_check_interval, std::memory_order_relaxed) + deadline_check_interval;
+            if (main_thread && (total >= node_limit || Clock::now() >= deadline)) {
+                stop.store(true, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Hands the rest of this thread's counts over to the shared totals
+    static void flush_counts() {
+        total_nodes.fetch_add(nodes % deadline_check_interval, std::memory_order_relaxed);
+        nodes -= nodes % deadline_check_interval;
+        transposition_table.add_stats(tt_stats);
+        tt_stats = TranspositionTable::Stats();
+    }
+
+    static bool should_stop() {
+        return stop.load(std::memory_order_relaxed);
+    }
+};
+
 template <unsigned int board_rad, bool save_actions>
-class MiniMax : public std::conditional<save_actions, ActionLog, DummyActionLog>::type {
+class MiniMax : public MiniMaxShared {
 public:
-    static constexpr unsigned int board_diam = board_rad * 2 + 1;
-    static constexpr unsigned int board_width = board_diam + 1;
-    static constexpr unsigned int board_height = board_diam;
-    static constexpr unsigned int num_cells = board_width * board_height;
+    // The root and the rest of the tree share one board type, so a search can work on a single board in place
+    typedef GameBoard<board_rad> Board;
+
+    static constexpr unsigned int board_radius = Board::board_radius;
+    static constexpr unsigned int board_diam = Board::board_diam;
+    static constexpr unsigned int board_width = Board::board_width;
+    static constexpr unsigned int board_height = Board::board_height;
+    static constexpr unsigned int num_cells = Board::num_cells;
+
+    typedef typename Board::SizedBitBoard SizedBitBoard;
+    typedef typename Board::SizedZobrist SizedZobrist;
 
-    static constexpr signed int flag_score = 1000000001;
     static constexpr signed int init_score = 1000000000;
     static constexpr signed int win_score = 1000000;
 
+    static constexpr unsigned int max_qdepth = 8;
+    static constexpr signed int delta_margin = 0;
+
+    // Captures that lose material by exchange aren't searched this close to the horizon
+    static constexpr unsigned int exchange_prune_depth = 2;
+
+    // Null move: plies saved by passing, and the material needed to trust a pass
+    static constexpr unsigned int null_move_reduction = 2;
+    static constexpr unsigned int null_move_min_depth = 3;
+    static constexpr unsigned int null_move_min_pieces = 4;
+
+    // Late move reductions: turns tried before reducing, and the depth needed to reduce at all
+    static constexpr unsigned int lmr_min_turns = 3;
+    static constexpr unsigned int lmr_min_depth = 3;
+    static constexpr unsigned int lmr_deep_turns = 12;
+
+    // Futility and razoring: how close to the leaves they apply, and the margin per ply, in material
+    static constexpr unsigned int futility_depth = 2;
+    static constexpr signed int futility_margin = piece_value;
+    static constexpr unsigned int razor_depth = 2;
+    static constexpr signed int razor_margin = 2 * piece_value;
+
+    // bench.cpp has copying at least as fast from radius 3 to 10: undoing needs a second branch on the action type
+    // and a second flip, which costs more than the words a copy writes, and searches come out even
+    static constexpr bool in_place_by_default = false;
+
     static constexpr signed int dir_offsets[] = {
         -static_cast<signed int>(board_width) + 1,
         1,
@@ -41,211 +177,348 @@ public:
         -static_cast<signed int>(board_width),
     };
 
-    typedef BitBoard<num_cells> SizedBitBoard;
-
-    class Board : public std::conditional<save_actions, ActionLog, DummyActionLog>::type {
-    public:
-        Board() {}
-
-        Board(
-            SizedBitBoard empties,
-            SizedBitBoard pieces,
-            SizedBitBoard teammates,
-            std::array<unsigned int, 2> kings,
-            std::array<unsigned int, 2> spawns
-        )
-            : empties(empties)
-            , pieces(pieces)
-            , teammates(teammates)
-            , kings(kings)
-            , spawns(spawns)
-        {}
-
-        SizedBitBoard empties;
-        SizedBitBoard pieces;
-        SizedBitBoard teammates;
-        std::array<unsigned int, 2> kings;
-        std::array<unsigned int, 2> spawns;
-
-        struct Hasher {
-            std::size_t operator()(const Board &board) const {
-                return board.calc_hash();
-            }
-        };
+    MiniMax(unsigned int depth)
+        : alpha(-init_score)
+        , beta(init_score)
+        , depth(depth - 1)
+        , ply(0)
+    {}
 
-        bool operator==(const Board &other) const {
-            return pieces == other.pieces && teammates == other.teammates && kings == other.kings && spawns == other.spawns;
-        }
+    MiniMax(signed int alpha, signed int beta, unsigned int depth, unsigned int ply = 0, bool allow_null = true)
+        : alpha(alpha)
+        , beta(beta)
+        , depth(depth - 1)
+        , ply(ply)
+        , allow_null(allow_null)
+    {}
 
-        Board move(unsigned int src, unsigned int dst) const {
-            assert(!empties.test(src));
-            assert(teammates.test(src));
-            assert(pieces.test(src));
-            assert(empties.test(dst));
-            assert(!teammates.test(dst));
-            assert(!pieces.test(dst));
+    // What the main thread had found after each completed iteration
+    struct Iteration {
+        unsigned int depth;
+        signed int score;
+        Action action;
+        unsigned long long nodes;
+        unsigned long long ms;
+    };
 
-            SizedBitBoard flip = SizedBitBoard::from_bits(src, dst);
-            Board res = Board(empties ^ flip, pieces ^ flip, teammates ^ flip, kings, spawns);
-            if (res.kings[0] == src) {res.kings[0] = dst;}
+    struct SearchResult {
+        signed int score = 0;
+        unsigned int depth = 0;
+        // Turns from the root, each closed by an EndTurn action
+        ActionLog pv;
+        std::vector<Iteration> iterations;
 
-            this->copy_actions_to(res);
-            res.add_action(ActionType::Move, src, dst);
+        // Summed over every thread, while the fields above all come from the one result that was picked
+        unsigned long long nodes = 0;
+    };
 
-            return res;
+    // Searches one ply deeper at a time until max_depth is done or time_ms runs out
+    // With more than one thread, helpers search the same root and the deepest completed result wins
+    static SearchResult search(const Board &board, unsigned int max_depth, unsigned int time_ms) {
+        static_assert(save_actions, "Only the root search fills in the principal variation");
+
+        Clock::time_point start = Clock::now();
+        // The first iteration always runs to the end, since a cut-short one has no score or move to trust
+        deadline = Clock::time_point::max();
+        node_limit = std::numeric_limits<unsigned long long>::max();
+        stop.store(false);
+        total_nodes.store(0);
+        transposition_table.new_search();
+
+        std::vector<SearchResult> results(num_threads ? num_threads : 1);
+        std::vector<std::thread> helpers;
+        for (unsigned int i = 1; i < results.size(); i++) {
+            helpers.emplace_back(search_thread, std::cref(board), max_depth, i, start, time_ms, std::ref(results[i]));
         }
 
-        Board jump(unsigned int src, unsigned int dst) const {
-            assert(!empties.test(src));
-            assert(teammates.test(src));
-            assert(pieces.test(src));
-            assert(!empties.test(dst));
-            assert(!teammates.test(dst));
-            assert(pieces.test(dst));
+        main_thread = true;
+        search_thread(board, max_depth, 0, start, time_ms, results[0]);
+        main_thread = false;
 
-            SizedBitBoard flip_1 = SizedBitBoard::from_bits(src);
-            SizedBitBoard flip_2 = SizedBitBoard::from_bits(src, dst);
-            Board res = Board(empties ^ flip_1, pieces ^ flip_1, teammates ^ flip_2, kings, spawns);
-            if (res.kings[0] == src) {res.kings[0] = dst; res.spawns[0]++;}
+        // The main thread decides when the search is over
+        stop.store(true);
+        for (std::thread &helper : helpers) {
+            helper.join();
+        }
 
-            this->copy_actions_to(res);
-            res.add_action(ActionType::Jump, src, dst);
+        SearchResult res = reduce_results(results);
+        res.nodes = total_nodes.load();
+        return res;
+    }
 
-            return res;
+    // The deepest completed iteration of any thread, preferring the main thread on ties
+    static SearchResult reduce_results(const std::vector<SearchResult> &results) {
+        const SearchResult *best = &results[0];
+        for (const SearchResult &res : results) {
+            if (res.depth > best->depth) {best = &res;}
         }
+        return *best;
+    }
 
-        Board glide(unsigned int src, unsigned int dst) const {
-            assert(!empties.test(src));
-            assert(teammates.test(src));
-            assert(pieces.test(src));
-            assert(empties.test(dst));
-            assert(!teammates.test(dst));
-            assert(!pieces.test(dst));
-
-            SizedBitBoard flip = SizedBitBoard::from_bits(src, dst);
-            Board res = Board(empties ^ flip, pieces ^ flip, teammates ^ flip, kings, spawns);
-            if (res.kings[0] == src) {res.kings[0] = dst;}
+    // Iterative deepening for one thread
+    // The result always comes from the last iteration that completed
+    static void search_thread(const Board &board, unsigned int max_depth, unsigned int thread_id, Clock::time_point start, unsigned int time_ms, SearchResult &res) {
+        nodes = 0;
+        tt_stats = TranspositionTable::Stats();
+        get_move_order<num_cells>().new_search();
+
+        // Searching in place changes this board as it goes, though it's always put back
+        Board root = board;
+        root.accumulator = 0;
+        if (use_network) {NetworkEval<board_rad>::attach(network, root);}
+
+        // Odd helpers run a ply ahead, so the threads don't all walk the same tree in lockstep
+        for (unsigned int plies = 1 + thread_id % 2; plies <= max_depth; plies++) {
+            signed int delta = aspiration_window;
+            bool narrow = use_aspiration && res.depth && res.score > -win_score && res.score < win_score;
+            signed int alpha = narrow ? res.score - delta : -init_score;
+            signed int beta = narrow ? res.score + delta : init_score;
+
+            MiniMax<board_rad, save_actions> alg(alpha, beta, plies + 1);
+            signed int score = alg.calc_score(root);
+
+            while (!should_stop() && (score <= alpha || score >= beta)) {
+                // Widen only the side that failed, falling back to the full window once the step gets huge
+                delta *= 4;
+                if (score <= alpha) {alpha = delta > win_score ? -init_score : score - delta;}
+                if (score >= beta) {beta = delta > win_score ? init_score : score + delta;}
+
+                alg = MiniMax<board_rad, save_actions>(alpha, beta, plies + 1);
+                score = alg.calc_score(root);
+            }
 
-            this->copy_actions_to(res);
-            res.add_action(ActionType::Glide, src, dst);
+            if (should_stop()) {break;}
 
-            return res;
-        }
+            res.score = score;
+            res.depth = plies;
+            res.pv = pv_table.get_line(0);
 
-        Board spawn(unsigned int dst) const {
-            assert(empties.test(dst));
-            assert(!teammates.test(dst));
-            assert(!pieces.test(dst));
+            unsigned long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+            unsigned long long approx_nodes = total_nodes.load(std::memory_order_relaxed) + nodes % deadline_check_interval;
+            res.iterations.push_back(Iteration{plies, score, alg.best_action, approx_nodes, ms});
 
-            SizedBitBoard flip = SizedBitBoard::from_bits(dst);
-            Board res = Board(empties ^ flip, pieces ^ flip, teammates ^ flip, kings, {spawns[0] - 1, spawns[1]});
+            if (thread_id == 0) {
+                std::cerr << "info depth " << plies << " score " << score << " nodes " << approx_nodes << " time " << ms << std::endl;
 
-            this->copy_actions_to(res);
-            res.add_action(ActionType::Spawn, 0, dst);
+                deadline = time_ms ? start + std::chrono::milliseconds(time_ms) : Clock::time_point::max();
+                node_limit = max_nodes ? max_nodes : std::numeric_limits<unsigned long long>::max();
+                if (approx_nodes >= node_limit || Clock::now() >= deadline) {break;}
+            }
 
-            return res;
+            // Searching deeper can't change a proven result
+            if (score >= win_score || score <= -win_score) {break;}
         }
 
-        template <typename BoardType>
-        BoardType flip_teams() const {
-            return BoardType(empties, pieces, pieces ^ teammates, {kings[1], kings[0]}, {spawns[1], spawns[0]});
+        flush_counts();
+    }
+
+    signed int calc_score(Board &board) {
+        pv_table.clear(ply);
+
+        if (depth == 0) {
+            return quiesce(board, alpha, beta, ply, 0);
         }
 
-        signed int calc_score() const {
-            return teammates.count_set_bits() * 2 - pieces.count_set_bits();
+        count_node();
+
+        assert(board.hash == board.calc_hash());
+        assert(board.material == board.calc_material());
+
+        // The root always searches, so that its line gets filled in
+        TranspositionTable::Data cached;
+        bool hit = transposition_table.probe(board.hash, cached, tt_stats);
+        if (hit) {
+            table_action = cached.action;
+        }
+        if (hit && cached.depth >= depth && !save_actions) {
+            switch (cached.bound) {
+                case TranspositionTable::Bound::Exact: return cached.score;
+                case TranspositionTable::Bound::Lower: if (cached.score >= beta) {return cached.score;} break;
+                case TranspositionTable::Bound::Upper: if (cached.score <= alpha) {return cached.score;} break;
+                case TranspositionTable::Bound::None: break;
+            }
         }
 
-        std::size_t calc_hash() const {
-            std::size_t res = empties.calc_hash();
-            res = jw_util::Hash::combine(res, pieces.calc_hash());
-            res = jw_util::Hash::combine(res, teammates.calc_hash());
-            res = jw_util::Hash::combine(res, (kings[0] << 24) | (kings[1] << 16) | (spawns[0] << 8) | spawns[1]);
-            return res;
+        checked = in_check(board);
+        if (!save_actions && !checked) {
+            signed int pruned;
+            if (try_razor(board, pruned) || try_null_move(board, pruned)) {return pruned;}
         }
 
-        std::string to_string() const {
-            std::string res;
+        signed int orig_alpha = alpha;
+        score = -init_score;
+        update<TurnState_Initial>(board);
 
-            for (unsigned int i = 0; i < num_cells; i++) {
-                unsigned int row = i / board_width;
-                unsigned int col = i % board_width;
+        if (should_stop()) {return score;}
 
-                if (col == 0) {
-                    for (unsigned int j = 0; j < row; j++) {
-                        res += ' ';
-                    }
+        TranspositionTable::Bound bound;
+        if (score <= orig_alpha) {bound = TranspositionTable::Bound::Upper;}
+        else if (score >= beta) {bound = TranspositionTable::Bound::Lower;}
+        else {bound = TranspositionTable::Bound::Exact;}
+        transposition_table.store(board.hash, score, depth, bound, best_action, tt_stats);
 
-                    res += '0' + (i / 100) % 10;
-                    res += '0' + (i / 10) % 10;
-                    res += '0' + (i / 1) % 10;
-                    res += ' ';
-                }
+        return score;
+    }
 
-                if (i == kings[0]) {res += 'O';}
-                else if (i == kings[1]) {res += 'X';}
-                else if (pieces.test(i)) {
-                    if (teammates.test(i)) {res += 'o';}
-                    else {res += 'x';}
-                }
-                else if (empties.test(i)) {res += '+';}
-                else {res += '.';}
+    // Resolves captures and threats against the enemy king before trusting the static score
+    // If our own king is threatened we can't stand pat, so every action gets searched
+    static signed int quiesce(Board &board, signed int alpha, signed int beta, unsigned int ply, unsigned int qdepth) {
+        static_assert(TurnState_Initial::AfterMove::must_end && TurnState_Initial::AfterJump::must_end && TurnState_Initial::AfterSpawn::must_end,
+            "Quiescence treats every action as a whole turn");
 
-                res += ' ';
+        count_node();
 
-                if (col == board_width - 1) {
-                    res += '\n';
-                }
-            }
+        signed int stand_pat = evaluate(board, alpha, beta);
+        if (qdepth >= max_qdepth || should_stop()) {
+            return stand_pat;
+        }
 
-            res += "O spn " + std::to_string(spawns[0]) + "\n";
-            res += "X spn " + std::to_string(spawns[1]) + "\n";
+        bool checked = in_check(board);
 
-            return res;
+        signed int best = -init_score;
+        if (!checked) {
+            if (stand_pat >= beta) {return stand_pat;}
+            if (stand_pat > alpha) {alpha = stand_pat;}
+            best = stand_pat;
         }
-    };
 
-    MiniMax(unsigned int depth)
-        : alpha(-init_score)
-        , beta(init_score)
-        , depth(depth - 1)
-    {}
+        ActionGen<MiniMax, TurnState_Initial> gen(board, Action(), 0, ply, !checked);
 
-    MiniMax(signed int alpha, signed int beta, unsigned int depth)
-        : alpha(alpha)
-        , beta(beta)
-        , depth(depth - 1)
-    {}
+        Action action;
+        while (gen.next(action)) {
+            // Skip captures that lose material, or can't win enough to reach alpha (delta pruning)
+            if (!checked && is_capture_stage(gen.get_stage())) {
+                bool threat = get_prox(board.get_enemy_kings()).test(action.dst);
+                signed int exchange = gen.get_exchange();
+                if (!threat && (exchange < 0 || stand_pat + exchange * piece_value + delta_margin <= alpha)) {continue;}
+            }
 
-    signed int calc_score(const Board board) {
-        if (depth == 0) {
-            return board.calc_score();
-        } else {
-            CacheScore &cache_score = cache[board];
-            if (cache_score.score == flag_score) {
-                score = -init_score;
-                update<TurnState_Initial>(board);
-                cache_score.score = score;
-                return score;
+            signed int child_score;
+            if (use_in_place()) {
+                typename Board::Undo undo = board.make(action);
+                board.flip();
+                child_score = -MiniMax<board_rad, false>::quiesce(board, -beta, -alpha, ply + 1, qdepth + 1);
+                board.flip();
+                board.unmake(undo);
             } else {
-                return cache_score.score;
+                Board child = board.apply(action).template flip_teams<Board>();
+                child_score = -MiniMax<board_rad, false>::quiesce(child, -beta, -alpha, ply + 1, qdepth + 1);
             }
+            if (child_score > best) {
+                best = child_score;
+                if (child_score > alpha) {
+                    alpha = child_score;
+                    if (alpha >= beta) {break;}
+                }
+            }
+        }
+
+        if (gen.found_win()) {
+            return win_score;
+        }
+
+        return best;
+    }
+
+    static signed int evaluate(const Board &board) {
+        if (use_network) {return NetworkEval<board_rad>::evaluate(network, board);}
+        return use_positional ? Evaluation<MiniMax>::evaluate(board) : board.calc_score() * piece_value;
+    }
+
+    static signed int evaluate(const Board &board, signed int alpha, signed int beta) {
+        if (use_network) {return NetworkEval<board_rad>::evaluate(network, board);}
+        signed int positional;
+        if (use_batch_eval && use_positional && EvaluationBatch<MiniMax>::take_score(board, positional)) {
+            assert(positional == Evaluation<MiniMax>::calc_positional_score(board));
+            return Evaluation<MiniMax>::evaluate(board, alpha, beta, positional);
         }
+        return use_positional ? Evaluation<MiniMax>::evaluate(board, alpha, beta) : board.calc_score() * piece_value;
+    }
+
+    static bool use_in_place() {
+        return make_mode == MakeMode::InPlace || (make_mode == MakeMode::Auto && in_place_by_default);
     }
 
     static unsigned int lookup_cell_id(unsigned int row, unsigned int col) {
         return row * board_width + col;
     }
 
+    // The cell and its six neighbors
+    static SizedBitBoard get_prox(unsigned int pos) {
+        return get_prox(SizedBitBoard::from_bits(pos));
+    }
+
+    // The same for every cell at once, such as all of a side's kings
+    // Each neighbor is shifted from the cells directly, since chaining shifts loses cells along the top and bottom edges
+    static SizedBitBoard get_prox(const SizedBitBoard &cells) {
+        return cells
+            | cells.template shift<dir_offsets[0]>()
+            | cells.template shift<dir_offsets[1]>()
+            | cells.template shift<dir_offsets[2]>()
+            | cells.template shift<dir_offsets[3]>()
+            | cells.template shift<dir_offsets[4]>()
+            | cells.template shift<dir_offsets[5]>();
+    }
+
+    // Stepping by the same offset from any cell stays on one line of indices, the ones congruent to it modulo the offset
+    // Opposite directions share a line, so there are three sets of lines with one line per remainder
+    static const SizedBitBoard &get_line(unsigned int pos, unsigned int dir) {
+        static const std::array<std::array<SizedBitBoard, board_width>, 3> lines = make_lines();
+        unsigned int axis = dir % 3;
+        return lines[axis][pos % get_line_step(axis)];
+    }
+
+    // The first cell from pos in direction dir that's in stops, or num_cells if stepping leaves the board first
+    // Cells off the hexagon are never empty, so with stops = ~empties this is where a glider's flight ends
+    static unsigned int find_blocker(const SizedBitBoard &stops, unsigned int pos, unsigned int dir) {
+        SizedBitBoard hits = get_line(pos, dir) & stops;
+        unsigned int next = pos + dir_offsets[dir];
+        return dir_offsets[dir] > 0 ? hits.next_bit(next) : hits.prev_bit(next);
+    }
+
+    // An enemy piece next to one of our kings can take it next turn
+    static bool in_check(const Board &board) {
+        return (get_prox(board.get_own_kings()) & board.pieces & ~board.teammates).has_bit();
+    }
+
+    static bool is_adjacent(unsigned int src, unsigned int dst) {
+        for (unsigned int dir = 0; dir < 6; dir++) {
+            if (dst == src + dir_offsets[dir]) {return true;}
+        }
+        return false;
+    }
+
+    // Whether our piece at pos can be shot in direction dir
+    static bool is_glider(const Board &board, unsigned int pos, unsigned int dir) {
+        unsigned int front = pos + dir_offsets[dir];
+        unsigned int wing_1 = pos + dir_offsets[dir + 2];
+        unsigned int wing_2 = pos + dir_offsets[dir + 4];
+        return board.teammates.test(pos)
+            && front < num_cells && board.empties.test(front)
+            && wing_1 < num_cells && board.teammates.test(wing_1)
+            && wing_2 < num_cells && board.teammates.test(wing_2);
+    }
+
 private:
     signed int score;
     signed int alpha;
     signed int beta;
     unsigned int depth;
-
-    struct CacheScore {
-        signed int score = flag_score;
-    };
-    static std::unordered_map<Board, CacheScore, typename Board::Hasher> cache;
+    unsigned int ply;
+    Action table_action;
+    Action best_action;
+    unsigned int num_turns = 0;
+    bool allow_null = true;
+    bool checked = false;
+    unsigned int reduction = 0;
+
+    // Worked out by the first pruning test that needs it, and shared with the others
+    signed int static_score = 0;
+    bool has_static_score = false;
+
+    // Actions of the turn being expanded, so the best one can go into the table and the line
+    std::array<Action, PvTable::max_turn_actions> turn;
+    unsigned int turn_length = 0;
 
     // Move: empty
     // Jump: enemy king
@@ -263,15 +536,25 @@ private:
     */
 
     template <typename TurnState>
-    bool update(const Board board) {
-        std::cout << board.to_string() << std::endl;
+    bool update(Board &board) {
+        if (should_stop()) {return true;}
 
         if (TurnState::can_end) {
-            typedef typename MiniMax<board_rad, false>::Board FlippedBoardType;
-            signed int child_score = -MiniMax<board_rad, false>(-beta, -alpha, depth).calc_score(board.template flip_teams<FlippedBoardType>());
+            signed int child_score;
+            if (use_in_place()) {
+                board.flip();
+                child_score = score_turn(board);
+                board.flip();
+            } else {
+                Board child = board.template flip_teams<Board>();
+                child_score = score_turn(child);
+            }
+            num_turns++;
+
             if (child_score > score) {
                 score = child_score;
-                board.copy_actions_to(*this);
+                best_action = turn[0];
+                pv_table.update(ply, turn.data(), turn_length);
                 if (child_score > alpha) {
                     alpha = child_score;
                     if (alpha >= beta) {return true;}
@@ -279,100 +562,224 @@ private:
             }
         }
 
-        if (TurnState::can_jump) {
-            // Check if any of our pieces can jump the enemy king
-            SizedBitBoard jumpers = SizedBitBoard::from_bits(board.kings[1]);
-            jumpers |= jumpers.template shift<dir_offsets[0]>();
-            jumpers |= jumpers.template shift<dir_offsets[2]>();
-            jumpers |= jumpers.template shift<dir_offsets[4]>();
-            jumpers &= board.teammates;
-            if (jumpers.has_bit()) {
-                score = win_score;
-                return true;
+        if (TurnState::must_end) {return false;}
+
+        // The stored action only applies at the start of a turn
+        Action first_action = std::is_same<TurnState, TurnState_Initial>::value ? table_action : Action();
+
+        MoveOrder<num_cells> &move_order = get_move_order<num_cells>();
+
+        // Every child of a node this close to the horizon goes straight into quiescence, which starts with its static score
+        if (use_batch_eval && use_positional && !use_network && depth == 1) {
+            BatchedActionGen<MiniMax, TurnState> gen(board, first_action, use_move_order ? &move_order : 0, ply);
+            return search_actions<TurnState>(board, gen);
+        }
+
+        ActionGen<MiniMax, TurnState> gen(board, first_action, use_move_order ? &move_order : 0, ply);
+        return search_actions<TurnState>(board, gen);
+    }
+
+    // The rest of update(), for either generator
+    template <typename TurnState, typename Gen>
+    bool search_actions(Board &board, Gen &gen) {
+        MoveOrder<num_cells> &move_order = get_move_order<num_cells>();
+
+        // Remember the quiet actions that didn't cut off, to demote them if a later one does
+        static constexpr unsigned int max_misses = 64;
+        std::array<Action, max_misses> misses;
+        unsigned int num_misses = 0;
+
+        // Quiet turns can't change the material, so they only matter here if the static score is close to alpha
+        bool futile = use_futility && !checked && depth <= futility_depth
+            && get_static_score(board) + futility_margin * static_cast<signed int>(depth) <= alpha;
+        SizedBitBoard threat_cells = get_prox(board.get_enemy_kings());
+
+        Action action;
+        while (gen.next(action)) {
+            bool capture = is_capture_stage(gen.get_stage());
+            if (depth <= exchange_prune_depth && score > -init_score && capture && gen.get_exchange() < 0) {
+                continue;
+            }
+
+            bool quiet = !capture && gen.get_stage() != Gen::Stage::TableAction && !threat_cells.test(action.dst);
+            if (futile && quiet && score > -init_score) {
+                continue;
             }
 
-            // Find all cells next to our king
-            SizedBitBoard king_prox = SizedBitBoard::from_bits(board.kings[0]);
-            king_prox |= king_prox.template shift<dir_offsets[0]>();
-            king_prox |= king_prox.template shift<dir_offsets[2]>();
-            king_prox |= king_prox.template shift<dir_offsets[4]>();
-
-            if (TurnState::can_spawn && board.spawns[0] > 0) {
-                // Check if our king can spawn a piece
-                SizedBitBoard spawns = king_prox & board.empties;
-                typename SizedBitBoard::FastBitEater i;
-                while (spawns.has_bit(i)) {
-                    unsigned int new_pos = spawns.pop_bit(i);
-                    if (update<typename TurnState::AfterSpawn>(board.spawn(new_pos))) {return true;}
+            reduction = 0;
+            if (use_lmr && quiet && !checked && depth >= lmr_min_depth && num_turns >= lmr_min_turns) {
+                reduction = num_turns >= lmr_deep_turns ? 2 : 1;
+            }
+
+            bool cutoff = expand<TurnState>(board, action);
+            reduction = 0;
+
+            if (cutoff) {
+                if (use_move_order && !should_stop()) {
+                    move_order.add_cutoff(action, board.side, ply, depth);
+                    for (unsigned int i = 0; i < num_misses; i++) {
+                        move_order.add_miss(misses[i], board.side, depth);
+                    }
                 }
+                return true;
             }
 
-            // Check if our king can jump any piece
-            SizedBitBoard jumps = king_prox & board.pieces & ~board.teammates;
-            typename SizedBitBoard::FastBitEater i;
-            while (jumps.has_bit(i)) {
-                unsigned int old_pos = board.kings[0];
-                unsigned int new_pos = jumps.pop_bit(i);
-                if (update<typename TurnState::AfterJump>(board.jump(old_pos, new_pos))) {return true;}
+            if (MoveOrder<num_cells>::is_quiet(action.type) && num_misses < max_misses) {
+                misses[num_misses++] = action;
             }
         }
 
-        if (score_dir<0, TurnState>(board)) {return true;}
-        if (score_dir<1, TurnState>(board)) {return true;}
-        if (score_dir<2, TurnState>(board)) {return true;}
-        if (score_dir<3, TurnState>(board)) {return true;}
-        if (score_dir<4, TurnState>(board)) {return true;}
-        if (score_dir<5, TurnState>(board)) {return true;}
+        // The win is never searched as a turn, but it's still the action to play, even if an earlier turn was best so far
+        if (gen.found_win()) {
+            assert(turn_length < PvTable::max_turn_actions);
+            score = win_score;
+            turn[turn_length] = gen.get_win_action();
+            best_action = turn[0];
+            // Nothing was searched below the capture, so the line ends with it
+            pv_table.clear(ply + 1);
+            pv_table.update(ply, turn.data(), turn_length + 1);
+            return true;
+        }
 
         return false;
     }
 
-    template <unsigned int dir, typename TurnState>
-    bool score_dir(const Board board) {
-        SizedBitBoard moves;
-        if (TurnState::can_move || TurnState::can_glide) {
-            moves = board.teammates & board.empties.template shift<dir_offsets[dir + 3]>();
+    // Searches the opponent's reply to the turn that led to child
+    signed int score_turn(Board &child) {
+        // Once a turn has been searched with the full window, the rest only have to prove they're no better
+        signed int child_score = 0;
+        bool full_depth = true;
+        if (reduction) {
+            // A reduced turn only gets its full depth back if it turns out to beat alpha
+            child_score = -MiniMax<board_rad, false>(-alpha - 1, -alpha, depth - reduction, ply + 1).calc_score(child);
+            full_depth = child_score > alpha && !should_stop();
         }
 
-        if (TurnState::can_glide) {
-            SizedBitBoard gliders = moves
-                & board.teammates.template shift<dir_offsets[dir + 5]>()
-                & board.teammates.template shift<dir_offsets[dir + 1]>();
-
-            if (!TurnState::try_move_after_glide) {
-                moves &= ~gliders;
-            }
-
-            typename SizedBitBoard::FastBitEater i;
-            while (gliders.has_bit(i)) {
-                unsigned int old_pos = gliders.pop_bit(i);
-                unsigned int new_pos = old_pos;
-
-                while (true) {
-                    new_pos += dir_offsets[dir];
-                    if (!board.empties.test(new_pos)) {
-                        if (board.pieces.test(new_pos) && !board.teammates.test(new_pos)) {
-                            // Capture enemy piece
-                            if (update<typename TurnState::AfterJump>(board.jump(old_pos, new_pos))) {return true;}
-                        }
-                        break;
-                    }
-                    if (update<typename TurnState::AfterJump>(board.glide(old_pos, new_pos))) {return true;}
+        if (full_depth) {
+            if (use_pvs && num_turns > 0 && beta - alpha > 1) {
+                child_score = -MiniMax<board_rad, false>(-alpha - 1, -alpha, depth, ply + 1).calc_score(child);
+                if (child_score > alpha && child_score < beta && !should_stop()) {
+                    child_score = -MiniMax<board_rad, false>(-beta, -alpha, depth, ply + 1).calc_score(child);
                 }
+            } else {
+                child_score = -MiniMax<board_rad, false>(-beta, -alpha, depth, ply + 1).calc_score(child);
             }
         }
 
-        if (TurnState::can_move) {
-            typename SizedBitBoard::FastBitEater i;
-            while (moves.has_bit(i)) {
-                unsigned int old_pos = moves.pop_bit(i);
-                unsigned int new_pos = old_pos + dir_offsets[dir];
-                if (update<typename TurnState::AfterMove>(board.move(old_pos, new_pos))) {return true;}
+        return child_score;
+    }
+
+    signed int get_static_score(const Board &board) {
+        if (!has_static_score) {
+            static_score = evaluate(board);
+            has_static_score = true;
+        }
+        return static_score;
+    }
+
+    // Drops into quiescence if the static score is so far below alpha that only captures could save it
+    bool try_razor(Board &board, signed int &res) {
+        if (!use_futility || depth > razor_depth) {return false;}
+
+        signed int margin = razor_margin * static_cast<signed int>(depth);
+        if (get_static_score(board) + margin > alpha) {return false;}
+
+        signed int q_score = quiesce(board, alpha - margin, alpha - margin + 1, ply, 0);
+        if (q_score > alpha - margin) {return false;}
+
+        res = q_score;
+        return true;
+    }
+
+    // Passing is never legal, so it's only trusted with enough material that some action is almost sure to be as good
+    bool try_null_move(Board &board, signed int &res) {
+        if (!use_null_move || !allow_null || depth < null_move_min_depth) {return false;}
+        if (beta >= win_score || beta <= -win_score) {return false;}
+        if (board.teammates.count_set_bits() < null_move_min_pieces || get_static_score(board) < beta) {return false;}
+
+        signed int null_score;
+        MiniMax<board_rad, false> null_alg(-beta, -beta + 1, depth - null_move_reduction, ply + 1, false);
+        if (use_in_place()) {
+            board.flip();
+            null_score = -null_alg.calc_score(board);
+            board.flip();
+        } else {
+            Board child = board.template flip_teams<Board>();
+            null_score = -null_alg.calc_score(child);
+        }
+        if (should_stop() || null_score < beta) {return false;}
+
+        res = null_score >= win_score ? beta : null_score;
+        return true;
+    }
+
+    static unsigned int get_line_step(unsigned int axis) {
+        return dir_offsets[axis] > 0 ? dir_offsets[axis] : -dir_offsets[axis];
+    }
+
+    static std::array<std::array<SizedBitBoard, board_width>, 3> make_lines() {
+        std::array<std::array<SizedBitBoard, board_width>, 3> res;
+        for (unsigned int axis = 0; axis < 3; axis++) {
+            res[axis].fill(SizedBitBoard::from_bits());
+            for (unsigned int pos = 0; pos < num_cells; pos++) {
+                res[axis][pos % get_line_step(axis)] |= SizedBitBoard::from_bits(pos);
             }
         }
+        return res;
+    }
 
-        return false;
+    template <typename Stage>
+    static bool is_capture_stage(Stage stage) {
+        return stage == Stage::KingCaptures || stage == Stage::GliderCaptures;
+    }
+
+    template <typename TurnState>
+    bool expand(Board &board, const Action &action) {
+        assert(turn_length < PvTable::max_turn_actions);
+        turn[turn_length++] = action;
+
+        bool res;
+        if (use_in_place()) {
+            typename Board::Undo undo = board.make(action);
+            res = update_after<TurnState>(board, action.type);
+            board.unmake(undo);
+        } else {
+            Board child = board.apply(action);
+            res = update_after<TurnState>(child, action.type);
+        }
+
+        turn_length--;
+        return res;
+    }
+
+    // Carries on the turn from the board an action of this type led to
+    template <typename TurnState>
+    bool update_after(Board &board, ActionType type) {
+        switch (type) {
+            case ActionType::Move: return update<typename TurnState::AfterMove>(board);
+            case ActionType::Jump: return update<typename TurnState::AfterJump>(board);
+            case ActionType::Glide: return update<typename TurnState::AfterJump>(board);
+            case ActionType::Spawn: return update<typename TurnState::AfterSpawn>(board);
+            default: assert(false); return false;
+        }
     }
 };
 
+// Defined here rather than in minimax.cpp so every board size gets it, not just the ones instantiated there
+template <unsigned int board_rad, bool save_actions>
+constexpr signed int MiniMax<board_rad, save_actions>::dir_offsets[];
+
+// Compiled once in minimax.cpp rather than in every file that searches
+extern template class MiniMax<3, true>;
+extern template class MiniMax<4, true>;
+extern template class MiniMax<5, true>;
+extern template class MiniMax<6, true>;
+extern template class MiniMax<7, true>;
+extern template class MiniMax<8, true>;
+extern template class MiniMax<9, true>;
+extern template class MiniMax<10, true>;
+
+template <unsigned int board_rad, bool save_actions>
+constexpr unsigned int MiniMax<board_rad, save_actions>::num_cells;
+
 #endif // MINIMAX_H
@@ -0,0 +1,180 @@
+#ifndef MOVEORDER_H
+#define MOVEORDER_H
+
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <assert.h>
+
+#include "actionlog.h"
+
+// The actions available from one node, kept packed so the list is cheap to put on the stack
+class ActionList {
+public:
+    static constexpr unsigned int capacity = 1024;
+
+    void add(ActionType type, unsigned int src, unsigned int dst) {
+        assert(count < capacity);
+        entries[count].packed = Action(type, src, dst).pack();
+        entries[count].score = 0;
+        count++;
+    }
+
+    void clear() {
+        count = 0;
+    }
+
+    unsigned int size() const {
+        return count;
+    }
+
+    Action get(unsigned int i) const {
+        assert(i < count);
+        return Action::unpack(entries[i].packed);
+    }
+
+    signed int get_score(unsigned int i) const {
+        assert(i < count);
+        return entries[i].score;
+    }
+
+    void set_score(unsigned int i, signed int score) {
+        assert(i < count);
+        entries[i].score = score;
+    }
+
+    // Swaps the best scored action of [i, size) into position i and returns it
+    // Cutoffs usually come early, so this beats sorting the whole list up front
+    Action pick(unsigned int i) {
+        assert(i < count);
+        unsigned int best = i;
+        for (unsigned int j = i + 1; j < count; j++) {
+            if (entries[j].score > entries[best].score) {best = j;}
+        }
+        std::swap(entries[i], entries[best]);
+        return Action::unpack(entries[i].packed);
+    }
+
+private:
+    struct Entry {
+        std::uint32_t packed;
+        signed int score;
+    };
+
+    unsigned int count = 0;
+    std::array<Entry, capacity> entries;
+};
+
+// Killer actions per ply and a history table per side, learned from beta cutoffs
+template <unsigned int num_cells>
+class MoveOrder {
+public:
+    static constexpr unsigned int max_ply = 128;
+    static constexpr unsigned int num_killers = 2;
+
+    static constexpr signed int capture_score = 1 << 30;
+    static constexpr signed int killer_score = 1 << 29;
+    static constexpr signed int max_history = 1 << 28;
+
+    MoveOrder()
+        : history(2 * num_types * num_cells * num_cells, 0)
+    {
+        clear_killers();
+    }
+
+    // Keeps what was learned last turn, but lets this turn's cutoffs take over quickly
+    void new_search() {
+        for (signed int &h : history) {
+            h /= 2;
+        }
+        clear_killers();
+    }
+
+    // Forgets everything, so the next search doesn't depend on what came before
+    void clear() {
+        std::fill(history.begin(), history.end(), 0);
+        clear_killers();
+    }
+
+    static bool is_quiet(ActionType type) {
+        return type != ActionType::Jump;
+    }
+
+    void order(ActionList &list, unsigned int side, unsigned int ply) const {
+        for (unsigned int i = 0; i < list.size(); i++) {
+            list.set_score(i, calc_score(list.get(i), side, ply));
+        }
+    }
+
+    signed int calc_score(const Action &action, unsigned int side, unsigned int ply) const {
+        if (!is_quiet(action.type)) {
+            return capture_score;
+        }
+
+        if (ply < max_ply) {
+            for (unsigned int i = 0; i < num_killers; i++) {
+                if (killers[ply][i] == action.pack()) {
+                    return killer_score - static_cast<signed int>(i);
+                }
+            }
+        }
+
+        return history[get_history_index(action, side)];
+    }
+
+    void add_cutoff(const Action &action, unsigned int side, unsigned int ply, unsigned int depth) {
+        if (!is_quiet(action.type)) {
+            return;
+        }
+
+        if (ply < max_ply && killers[ply][0] != action.pack()) {
+            for (unsigned int i = num_killers - 1; i > 0; i--) {
+                killers[ply][i] = killers[ply][i - 1];
+            }
+            killers[ply][0] = action.pack();
+        }
+
+        signed int &h = history[get_history_index(action, side)];
+        h += depth * depth;
+        if (h > max_history) {
+            for (signed int &other : history) {
+                other /= 2;
+            }
+        }
+    }
+
+    // Quiet actions that were tried before the cutoff action lose some standing
+    void add_miss(const Action &action, unsigned int side, unsigned int depth) {
+        if (!is_quiet(action.type)) {
+            return;
+        }
+
+        signed int &h = history[get_history_index(action, side)];
+        h -= depth * depth;
+        if (h < -max_history) {
+            for (signed int &other : history) {
+                other /= 2;
+            }
+        }
+    }
+
+private:
+    static constexpr unsigned int num_types = static_cast<unsigned int>(ActionType::EndTurn) + 1;
+
+    std::vector<signed int> history;
+    std::array<std::array<std::uint32_t, num_killers>, max_ply> killers;
+
+    void clear_killers() {
+        for (std::array<std::uint32_t, num_killers> &ply_killers : killers) {
+            ply_killers.fill(0);
+        }
+    }
+
+    static unsigned int get_history_index(const Action &action, unsigned int side) {
+        return ((side * num_types + static_cast<unsigned int>(action.type)) * num_cells + action.src) * num_cells + action.dst;
+    }
+};
+
+#endif // MOVEORDER_H
@@ -0,0 +1,197 @@
+#ifndef MULTIBOARD_H
+#define MULTIBOARD_H
+
+#include <array>
+#include <string>
+#include <assert.h>
+
+#include "gameboard.h"
+#include "actionlog.h"
+
+// A position for three or six players, who move in turn and drop out when their king is taken
+// Unlike GameBoard, players are absolute: players[i] is player i's pieces whoever is to move, and next_turn() replaces flip_teams()
+// Kings are one bitboard for everyone, split by players like pieces
+// A player who lost all their kings keeps their other pieces on the board, as in the web game, but never moves again
+template <unsigned int board_rad, unsigned int num_players>
+class MultiBoard {
+public:
+    static constexpr unsigned int board_radius = GameBoard<board_rad>::board_radius;
+    static constexpr unsigned int board_width = GameBoard<board_rad>::board_width;
+    static constexpr unsigned int num_cells = GameBoard<board_rad>::num_cells;
+
+    typedef typename GameBoard<board_rad>::SizedBitBoard SizedBitBoard;
+
+    MultiBoard() {}
+
+    MultiBoard(
+        SizedBitBoard empties,
+        std::array<SizedBitBoard, num_players> players,
+        SizedBitBoard kings,
+        std::array<unsigned int, num_players> spawns,
+        unsigned int to_move = 0
+    )
+        : empties(empties)
+        , players(players)
+        , kings(kings)
+        , spawns(spawns)
+        , to_move(to_move)
+    {
+        pieces = SizedBitBoard::from_bits();
+        for (const SizedBitBoard &player : players) {
+            pieces |= player;
+        }
+    }
+
+    SizedBitBoard empties;
+    SizedBitBoard pieces;
+    std::array<SizedBitBoard, num_players> players;
+    SizedBitBoard kings;
+    std::array<unsigned int, num_players> spawns;
+
+    unsigned int to_move;
+
+    bool is_alive(unsigned int player) const {
+        return (kings & players[player]).has_bit();
+    }
+
+    unsigned int count_alive() const {
+        unsigned int res = 0;
+        for (unsigned int player = 0; player < num_players; player++) {
+            res += is_alive(player);
+        }
+        return res;
+    }
+
+    // The player left once everyone else is out, or num_players while the game goes on
+    unsigned int get_winner() const {
+        if (count_alive() != 1) {return num_players;}
+        for (unsigned int player = 0; player < num_players; player++) {
+            if (is_alive(player)) {return player;}
+        }
+        return num_players;
+    }
+
+    unsigned int get_owner(unsigned int pos) const {
+        assert(pieces.test(pos));
+        for (unsigned int player = 0; player < num_players; player++) {
+            if (players[player].test(pos)) {return player;}
+        }
+        assert(false);
+        return num_players;
+    }
+
+    MultiBoard move(unsigned int src, unsigned int dst) const {
+        assert(players[to_move].test(src));
+        assert(empties.test(dst));
+
+        SizedBitBoard flip = SizedBitBoard::from_bits(src, dst);
+        MultiBoard res = *this;
+        res.empties ^= flip;
+        res.pieces ^= flip;
+        res.players[to_move] ^= flip;
+        if (kings.test(src)) {res.kings ^= flip;}
+        return res;
+    }
+
+    // Taking a player's last king puts them out; a king that captures earns a spawn, as in the two player game
+    MultiBoard jump(unsigned int src, unsigned int dst) const {
+        assert(players[to_move].test(src));
+        assert(pieces.test(dst) && !players[to_move].test(dst));
+
+        unsigned int victim = get_owner(dst);
+        SizedBitBoard flip_1 = SizedBitBoard::from_bits(src);
+        MultiBoard res = *this;
+        res.empties ^= flip_1;
+        res.pieces ^= flip_1;
+        res.players[to_move] ^= SizedBitBoard::from_bits(src, dst);
+        res.players[victim] ^= SizedBitBoard::from_bits(dst);
+        if (kings.test(dst)) {res.kings ^= SizedBitBoard::from_bits(dst);}
+        if (kings.test(src)) {
+            res.kings ^= SizedBitBoard::from_bits(src, dst);
+            res.spawns[to_move]++;
+        }
+        return res;
+    }
+
+    MultiBoard glide(unsigned int src, unsigned int dst) const {
+        return move(src, dst);
+    }
+
+    MultiBoard spawn(unsigned int dst) const {
+        assert(empties.test(dst));
+        assert(spawns[to_move] > 0);
+
+        SizedBitBoard flip = SizedBitBoard::from_bits(dst);
+        MultiBoard res = *this;
+        res.empties ^= flip;
+        res.pieces ^= flip;
+        res.players[to_move] ^= flip;
+        res.spawns[to_move]--;
+        return res;
+    }
+
+    MultiBoard apply(const Action &action) const {
+        switch (action.type) {
+            case ActionType::Move: return move(action.src, action.dst);
+            case ActionType::Jump: return jump(action.src, action.dst);
+            case ActionType::Glide: return glide(action.src, action.dst);
+            case ActionType::Spawn: return spawn(action.dst);
+            default: assert(false); return *this;
+        }
+    }
+
+    // Hands the turn to the next player still in the game
+    void next_turn() {
+        for (unsigned int i = 0; i < num_players; i++) {
+            to_move = (to_move + 1) % num_players;
+            if (is_alive(to_move)) {return;}
+        }
+    }
+
+    // Material from one player's point of view; with two players this is GameBoard::calc_score()
+    signed int calc_score(unsigned int player) const {
+        return static_cast<signed int>(players[player].count_set_bits() * num_players) - static_cast<signed int>(pieces.count_set_bits());
+    }
+
+    // Kings are the player's number, pieces the matching letter
+    std::string to_string() const {
+        std::string res;
+
+        for (unsigned int i = 0; i < num_cells; i++) {
+            unsigned int row = i / board_width;
+            unsigned int col = i % board_width;
+
+            if (col == 0) {
+                for (unsigned int j = 0; j < row; j++) {
+                    res += ' ';
+                }
+
+                res += '0' + (i / 100) % 10;
+                res += '0' + (i / 10) % 10;
+                res += '0' + (i / 1) % 10;
+                res += ' ';
+            }
+
+            if (pieces.test(i)) {
+                unsigned int owner = get_owner(i);
+                res += static_cast<char>(kings.test(i) ? '0' + owner : 'a' + owner);
+            }
+            else if (empties.test(i)) {res += '+';}
+            else {res += '.';}
+
+            res += ' ';
+
+            if (col == board_width - 1) {
+                res += '\n';
+            }
+        }
+
+        for (unsigned int player = 0; player < num_players; player++) {
+            res += std::to_string(player) + (is_alive(player) ? " spn " + std::to_string(spawns[player]) : " out") + "\n";
+        }
+
+        return res;
+    }
+};
+
+#endif // MULTIBOARD_H
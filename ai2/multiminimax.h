@@ -0,0 +1,320 @@
+#ifndef MULTIMINIMAX_H
+#define MULTIMINIMAX_H
+
+#include <iostream>
+#include <array>
+#include <chrono>
+#include <assert.h>
+
+#include "minimax.h"
+#include "multiboard.h"
+
+// Search for three and six player games, where every player moves in turn
+// Paranoid assumes everyone else plays against the player to move at the root, which turns the game back into
+// two sides and keeps alpha-beta; max^n lets every player pick what's best for themselves, which is more
+// realistic but can't prune, so it gets a ply or two less in the same time
+// The two player search's extras (transposition table, quiescence, history ordering) aren't used here yet
+template <unsigned int board_rad, unsigned int num_players>
+class MultiMiniMax : public MiniMaxShared {
+public:
+    typedef MultiBoard<board_rad, num_players> Board;
+
+    // Supplies the board geometry, which doesn't depend on the number of players
+    typedef MiniMax<board_rad, false> Geometry;
+
+    static constexpr unsigned int board_radius = Board::board_radius;
+    static constexpr unsigned int num_cells = Board::num_cells;
+
+    typedef typename Board::SizedBitBoard SizedBitBoard;
+    typedef std::array<signed int, num_players> Scores;
+
+    static constexpr signed int init_score = Geometry::init_score;
+    static constexpr signed int win_score = Geometry::win_score;
+
+    static_assert(num_players >= 2 && num_players <= 6, "The web game has two to six players");
+
+    enum class Mode {Paranoid, MaxN};
+
+    struct SearchResult {
+        unsigned int depth = 0;
+        unsigned long long nodes = 0;
+        Action action;
+        // Paranoid only fills in the score of the player to move at the root
+        Scores scores = {};
+    };
+
+    static unsigned int lookup_cell_id(unsigned int row, unsigned int col) {
+        return Geometry::lookup_cell_id(row, col);
+    }
+
+    // Searches one ply (one player's turn) deeper at a time until max_depth is done or time_ms runs out
+    static SearchResult search(const Board &board, Mode mode, unsigned int max_depth, unsigned int time_ms) {
+        static_assert(TurnState_Initial::AfterMove::must_end && TurnState_Initial::AfterJump::must_end && TurnState_Initial::AfterSpawn::must_end,
+            "Every turn here is a single action");
+
+        Clock::time_point start = Clock::now();
+        deadline = time_ms ? start + std::chrono::milliseconds(time_ms) : Clock::time_point::max();
+        stop.store(false);
+        total_nodes.store(0);
+        nodes = 0;
+
+        const unsigned int root = board.to_move;
+        ActionList actions;
+        gen_actions(board, actions);
+
+        SearchResult res;
+        for (unsigned int plies = 1; plies <= max_depth && actions.size(); plies++) {
+            unsigned int best = actions.size();
+            Scores best_scores = {};
+            signed int alpha = -init_score;
+
+            for (unsigned int i = 0; i < actions.size(); i++) {
+                Board child = board.apply(actions.get(i));
+                child.next_turn();
+
+                Scores scores = {};
+                if (mode == Mode::Paranoid) {
+                    scores[root] = paranoid(child, root, plies - 1, alpha, init_score);
+                } else {
+                    scores = maxn(child, plies - 1);
+                }
+
+                if (should_stop()) {break;}
+
+                if (best == actions.size() || scores[root] > best_scores[root]) {
+                    best = i;
+                    best_scores = scores;
+                    if (scores[root] > alpha) {alpha = scores[root];}
+                }
+            }
+
+            // A partial first iteration is still better than no action at all
+            if (should_stop() && (res.depth || best == actions.size())) {
+                if (!res.depth) {res.action = actions.get(0);}
+                break;
+            }
+
+            res.depth = plies;
+            res.action = actions.get(best);
+            res.scores = best_scores;
+
+            // The next iteration starts with this one's best action, which makes paranoid's window useful sooner
+            for (unsigned int i = 0; i < actions.size(); i++) {
+                actions.set_score(i, i == best);
+            }
+            actions.pick(0);
+
+            unsigned long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+            unsigned long long approx_nodes = total_nodes.load(std::memory_order_relaxed) + nodes % deadline_check_interval;
+            std::cerr << "info depth " << plies << " score " << best_scores[root] << " nodes " << approx_nodes << " time " << ms << std::endl;
+
+            if (should_stop()) {break;}
+            if (best_scores[root] >= win_score || best_scores[root] <= -win_score) {break;}
+        }
+
+        flush_counts();
+        res.nodes = total_nodes.load();
+        return res;
+    }
+
+    // Every action of the player to move, captures first
+    static void gen_actions(const Board &board, ActionList &actions) {
+        const unsigned int player = board.to_move;
+        const SizedBitBoard &own = board.players[player];
+        const SizedBitBoard kings = board.kings & own;
+        assert(board.is_alive(player));
+
+        // Any piece next to an enemy king can take it
+        SizedBitBoard enemy_kings = board.kings & ~own;
+
+        SizedBitBoard targets = enemy_kings & Geometry::get_prox(own);
+        typename SizedBitBoard::FastBitEater i;
+        while (targets.has_bit(i)) {
+            unsigned int target = targets.pop_bit(i);
+            SizedBitBoard attackers = Geometry::get_prox(target) & own;
+            typename SizedBitBoard::FastBitEater j;
+            while (attackers.has_bit(j)) {
+                actions.add(ActionType::Jump, attackers.pop_bit(j), target);
+            }
+        }
+
+        // Our kings can take any other piece next to them
+        SizedBitBoard victims = board.pieces & ~own & ~enemy_kings;
+        SizedBitBoard remaining_kings = kings;
+        typename SizedBitBoard::FastBitEater k;
+        while (remaining_kings.has_bit(k)) {
+            unsigned int king = remaining_kings.pop_bit(k);
+            SizedBitBoard jumps = Geometry::get_prox(king) & victims;
+            typename SizedBitBoard::FastBitEater j;
+            while (jumps.has_bit(j)) {
+                actions.add(ActionType::Jump, king, jumps.pop_bit(j));
+            }
+        }
+
+        SizedBitBoard stops = ~board.empties;
+        std::array<SizedBitBoard, 6> gliders;
+        gen_glider_captures<0>(board, stops, gliders, actions);
+        gen_glider_captures<1>(board, stops, gliders, actions);
+        gen_glider_captures<2>(board, stops, gliders, actions);
+        gen_glider_captures<3>(board, stops, gliders, actions);
+        gen_glider_captures<4>(board, stops, gliders, actions);
+        gen_glider_captures<5>(board, stops, gliders, actions);
+
+        gen_glides<0>(stops, gliders, actions);
+        gen_glides<1>(stops, gliders, actions);
+        gen_glides<2>(stops, gliders, actions);
+        gen_glides<3>(stops, gliders, actions);
+        gen_glides<4>(stops, gliders, actions);
+        gen_glides<5>(stops, gliders, actions);
+
+        if (board.spawns[player] > 0) {
+            SizedBitBoard spawns = Geometry::get_prox(kings) & board.empties;
+            typename SizedBitBoard::FastBitEater j;
+            while (spawns.has_bit(j)) {
+                actions.add(ActionType::Spawn, 0, spawns.pop_bit(j));
+            }
+        }
+
+        gen_moves<0>(board, gliders, actions);
+        gen_moves<1>(board, gliders, actions);
+        gen_moves<2>(board, gliders, actions);
+        gen_moves<3>(board, gliders, actions);
+        gen_moves<4>(board, gliders, actions);
+        gen_moves<5>(board, gliders, actions);
+    }
+
+    // Each player's view of a finished or cut off line
+    static Scores evaluate(const Board &board) {
+        unsigned int winner = board.get_winner();
+
+        Scores res;
+        for (unsigned int player = 0; player < num_players; player++) {
+            if (!board.is_alive(player)) {res[player] = -win_score;}
+            else if (winner == player) {res[player] = win_score;}
+            else {res[player] = board.calc_score(player);}
+        }
+        return res;
+    }
+
+private:
+    // The root player maximizes and everyone else minimizes the root player's score
+    static signed int paranoid(const Board &board, unsigned int root, unsigned int depth, signed int alpha, signed int beta) {
+        count_node();
+
+        if (!board.is_alive(root)) {return -win_score;}
+        if (board.get_winner() == root) {return win_score;}
+        if (depth == 0 || should_stop()) {return board.calc_score(root);}
+
+        ActionList actions;
+        gen_actions(board, actions);
+
+        // Nothing to do is a pass rather than a loss
+        if (!actions.size()) {
+            Board child = board;
+            child.next_turn();
+            return paranoid(child, root, depth - 1, alpha, beta);
+        }
+
+        bool maximize = board.to_move == root;
+        signed int best = maximize ? -init_score : init_score;
+        for (unsigned int i = 0; i < actions.size(); i++) {
+            Board child = board.apply(actions.get(i));
+            child.next_turn();
+            signed int score = paranoid(child, root, depth - 1, alpha, beta);
+
+            if (maximize) {
+                if (score > best) {best = score;}
+                if (best > alpha) {alpha = best;}
+            } else {
+                if (score < best) {best = score;}
+                if (best < beta) {beta = best;}
+            }
+            if (alpha >= beta) {break;}
+        }
+
+        return best;
+    }
+
+    // Every player picks the child that's best for themselves
+    // Scores don't add up to a constant, so there's nothing to prune except after a win
+    static Scores maxn(const Board &board, unsigned int depth) {
+        count_node();
+
+        if (depth == 0 || board.get_winner() != num_players || should_stop()) {return evaluate(board);}
+
+        ActionList actions;
+        gen_actions(board, actions);
+
+        if (!actions.size()) {
+            Board child = board;
+            child.next_turn();
+            return maxn(child, depth - 1);
+        }
+
+        const unsigned int player = board.to_move;
+        Scores best = {};
+        for (unsigned int i = 0; i < actions.size(); i++) {
+            Board child = board.apply(actions.get(i));
+            child.next_turn();
+            Scores scores = maxn(child, depth - 1);
+
+            if (i == 0 || scores[player] > best[player]) {best = scores;}
+            if (best[player] >= win_score) {break;}
+        }
+
+        return best;
+    }
+
+    template <unsigned int dir>
+    static SizedBitBoard get_steps(const Board &board) {
+        return board.players[board.to_move] & board.empties.template shift<Geometry::dir_offsets[dir + 3]>();
+    }
+
+    template <unsigned int dir>
+    static void gen_glider_captures(const Board &board, const SizedBitBoard &stops, std::array<SizedBitBoard, 6> &gliders, ActionList &actions) {
+        const SizedBitBoard &own = board.players[board.to_move];
+        gliders[dir] = get_steps<dir>(board)
+            & own.template shift<Geometry::dir_offsets[dir + 5]>()
+            & own.template shift<Geometry::dir_offsets[dir + 1]>();
+
+        SizedBitBoard remaining = gliders[dir];
+        typename SizedBitBoard::FastBitEater i;
+        while (remaining.has_bit(i)) {
+            unsigned int old_pos = remaining.pop_bit(i);
+            unsigned int new_pos = Geometry::find_blocker(stops, old_pos, dir);
+            if (new_pos < num_cells && board.pieces.test(new_pos) && !own.test(new_pos)) {
+                actions.add(ActionType::Jump, old_pos, new_pos);
+            }
+        }
+    }
+
+    template <unsigned int dir>
+    static void gen_glides(const SizedBitBoard &stops, const std::array<SizedBitBoard, 6> &gliders, ActionList &actions) {
+        SizedBitBoard remaining = gliders[dir];
+        typename SizedBitBoard::FastBitEater i;
+        while (remaining.has_bit(i)) {
+            unsigned int old_pos = remaining.pop_bit(i);
+            unsigned int blocker = Geometry::find_blocker(stops, old_pos, dir);
+            for (unsigned int new_pos = old_pos + Geometry::dir_offsets[dir]; new_pos != blocker && new_pos < num_cells; new_pos += Geometry::dir_offsets[dir]) {
+                actions.add(ActionType::Glide, old_pos, new_pos);
+            }
+        }
+    }
+
+    // A glider's one cell glide already covers the same step
+    template <unsigned int dir>
+    static void gen_moves(const Board &board, const std::array<SizedBitBoard, 6> &gliders, ActionList &actions) {
+        SizedBitBoard moves = get_steps<dir>(board) & ~gliders[dir];
+        typename SizedBitBoard::FastBitEater i;
+        while (moves.has_bit(i)) {
+            unsigned int old_pos = moves.pop_bit(i);
+            actions.add(ActionType::Move, old_pos, old_pos + Geometry::dir_offsets[dir]);
+        }
+    }
+};
+
+// Taken by reference when formations fill the kings, so it needs a definition at -O0
+template <unsigned int board_rad, unsigned int num_players>
+constexpr unsigned int MultiMiniMax<board_rad, num_players>::num_cells;
+
+#endif // MULTIMINIMAX_H
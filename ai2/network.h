@@ -0,0 +1,489 @@
+#ifndef NETWORK_H
+#define NETWORK_H
+
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <random>
+#include <assert.h>
+
+#include "cpudispatch.h"
+
+// The layers get an AVX2 copy whatever flags the rest of the build uses, picked at runtime like BitBoardWords
+#if defined(__x86_64__) || defined(__i386__)
+#define NETWORK_X86
+#define NETWORK_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+
+template <unsigned int board_rad>
+class GameBoard;
+
+// A small learned evaluator for two player positions, with weights loaded from a file
+// Every feature (a cell holding a piece or a king, ours or theirs, and how many spawns each side has left) adds a column
+// of first layer weights to an int16 accumulator, one per player; two int8 layers on top turn both accumulators into a score
+// in the same units as Evaluation
+// Cells are placed around the center of the largest board, so one set of weights fits every board size
+// The layers use AVX2 whenever CpuDispatch picked an ISA that has it, and plain loops otherwise, with the same results
+class Network {
+public:
+    // The largest GameBoard, laid out the same way
+    static constexpr unsigned int max_radius = 10;
+    static constexpr unsigned int max_width = 2 * max_radius + 2;
+    static constexpr unsigned int max_cells = max_width * (2 * max_radius + 1);
+
+    // The last bucket is for that many spawns or more
+    static constexpr unsigned int spawn_buckets = 4;
+
+    // Pieces ours and theirs, kings ours and theirs, then spawn buckets ours and theirs
+    static constexpr unsigned int num_features = 4 * max_cells + 2 * spawn_buckets;
+    // Per player
+    static constexpr unsigned int hidden_size = 32;
+    static constexpr unsigned int l2_size = 32;
+
+    // Activations are clipped to fit in a uint8, and small enough that maddubs never saturates a pair of products
+    static constexpr signed int max_activation = 127;
+
+    static constexpr std::uint32_t version = 1;
+
+    static_assert(hidden_size % 32 == 0 && l2_size % 4 == 0, "The AVX2 layers work in whole registers");
+
+    static unsigned int get_cell_feature(bool king, bool theirs, unsigned int max_cell) {
+        return (king * 2 + theirs) * max_cells + max_cell;
+    }
+
+    static unsigned int get_spawn_feature(bool theirs, unsigned int spawns) {
+        return 4 * max_cells + theirs * spawn_buckets + get_spawn_bucket(spawns);
+    }
+
+    static unsigned int get_spawn_bucket(unsigned int spawns) {
+        return std::min(spawns, spawn_buckets - 1);
+    }
+
+    // Where a cell of a board_rad board sits on the largest one, lined up by the center
+    template <unsigned int board_rad>
+    static unsigned int get_max_cell(unsigned int cell) {
+        static constexpr unsigned int width = 2 * board_rad + 2;
+        static constexpr unsigned int offset = max_radius - board_rad;
+        return (cell / width + offset) * max_width + cell % width + offset;
+    }
+
+    bool is_loaded() const {return !l1_weights.empty();}
+
+    // A file is "GLNN", then version, num_features, hidden_size, l2_size, l2_shift and out_shift as uint32, then the
+    // first layer's columns (int16, hidden_size per feature) and biases (int16), the second layer's rows (int8, each
+    // 2 * hidden_size long, the player to move's inputs first) and biases (int32), and the output weights (int8, one per
+    // second layer unit) and bias (int32), all little-endian with nothing after
+    bool load(const std::string &path, std::string &error) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            error = "Can't open " + path;
+            return false;
+        }
+
+        std::array<char, 4> magic;
+        std::array<std::uint32_t, 6> header;
+        file.read(magic.data(), magic.size());
+        read_values(file, header.data(), header.size());
+        if (!file || std::string(magic.data(), magic.size()) != "GLNN") {
+            error = path + " isn't a network file";
+            return false;
+        }
+        if (header[0] != version) {
+            error = path + " is version " + std::to_string(header[0]) + ", not " + std::to_string(version);
+            return false;
+        }
+        if (header[1] != num_features || header[2] != hidden_size || header[3] != l2_size) {
+            error = path + " has " + std::to_string(header[1]) + " features and layers of " + std::to_string(header[2])
+                + " and " + std::to_string(header[3]) + ", but this build has " + std::to_string(num_features)
+                + ", " + std::to_string(hidden_size) + " and " + std::to_string(l2_size);
+            return false;
+        }
+        if (header[4] >= 32 || header[5] >= 32) {
+            error = path + " has a shift of 32 or more";
+            return false;
+        }
+
+        Network res;
+        res.l2_shift = header[4];
+        res.out_shift = header[5];
+        res.l1_weights.resize(num_features * hidden_size);
+        read_values(file, res.l1_weights.data(), res.l1_weights.size());
+        read_values(file, res.l1_biases.data(), res.l1_biases.size());
+        read_values(file, res.l2_weights.data(), res.l2_weights.size());
+        read_values(file, res.l2_biases.data(), res.l2_biases.size());
+        read_values(file, res.out_weights.data(), res.out_weights.size());
+        read_values(file, &res.out_bias, 1);
+        if (!file) {
+            error = path + " is too short";
+            return false;
+        }
+        if (file.peek() != std::ifstream::traits_type::eof()) {
+            error = path + " is too long";
+            return false;
+        }
+
+        *this = std::move(res);
+        return true;
+    }
+
+    bool save(const std::string &path, std::string &error) const {
+        std::ofstream file(path, std::ios::binary);
+        if (!file) {
+            error = "Can't open " + path;
+            return false;
+        }
+
+        std::array<std::uint32_t, 6> header = {{version, num_features, hidden_size, l2_size, l2_shift, out_shift}};
+        file.write("GLNN", 4);
+        write_values(file, header.data(), header.size());
+        write_values(file, l1_weights.data(), l1_weights.size());
+        write_values(file, l1_biases.data(), l1_biases.size());
+        write_values(file, l2_weights.data(), l2_weights.size());
+        write_values(file, l2_biases.data(), l2_biases.size());
+        write_values(file, out_weights.data(), out_weights.size());
+        write_values(file, &out_bias, 1);
+        if (!file) {
+            error = "Can't write " + path;
+            return false;
+        }
+        return true;
+    }
+
+    // Scores material exactly, like --no-positional, so a search with it can be checked against one without it
+    // Also a starting point for training; the counts it keeps are clipped, so it's only exact up to 127 pieces a side
+    static Network make_material(signed int piece_value) {
+        Network res;
+        res.l1_weights.assign(num_features * hidden_size, 0);
+        res.l1_biases.fill(0);
+        res.l2_weights.fill(0);
+        res.l2_biases.fill(0);
+        res.out_weights.fill(0);
+        res.out_bias = 0;
+        res.l2_shift = 0;
+        res.out_shift = 0;
+
+        // Each accumulator counts its player's pieces in unit 0 and the other player's in unit 1
+        for (unsigned int cell = 0; cell < max_cells; cell++) {
+            for (unsigned int king = 0; king < 2; king++) {
+                for (unsigned int theirs = 0; theirs < 2; theirs++) {
+                    res.l1_weights[get_cell_feature(king, theirs, cell) * hidden_size + theirs] = 1;
+                }
+            }
+        }
+
+        // One unit for each sign of the difference, since the activations can't go negative
+        res.l2_weights[0] = 1;
+        res.l2_weights[1] = -1;
+        res.l2_weights[2 * hidden_size] = -1;
+        res.l2_weights[2 * hidden_size + 1] = 1;
+        res.out_weights[0] = piece_value;
+        res.out_weights[1] = -piece_value;
+        return res;
+    }
+
+    // Weights with nothing to do with the game, but different for every feature, so tests can tell any two apart
+    static Network make_random(unsigned int seed) {
+        std::mt19937 rng(seed);
+        std::uniform_int_distribution<signed int> small(-64, 64);
+
+        Network res = make_material(1);
+        for (std::int16_t &weight : res.l1_weights) {weight = static_cast<std::int16_t>(small(rng));}
+        for (std::int16_t &bias : res.l1_biases) {bias = static_cast<std::int16_t>(small(rng));}
+        for (std::int8_t &weight : res.l2_weights) {weight = static_cast<std::int8_t>(small(rng));}
+        for (std::int8_t &weight : res.out_weights) {weight = static_cast<std::int8_t>(small(rng));}
+        res.l2_shift = 6;
+        return res;
+    }
+
+    void reset(std::int16_t *acc) const {
+        std::copy(l1_biases.begin(), l1_biases.end(), acc);
+    }
+
+    void add_column(std::int16_t *acc, unsigned int feature) const {
+        const std::int16_t *column = get_column(feature);
+#ifdef NETWORK_X86
+        if (use_avx2()) {return add_column_avx2(acc, column);}
+#endif
+        for (unsigned int i = 0; i < hidden_size; i++) {
+            acc[i] = static_cast<std::int16_t>(acc[i] + column[i]);
+        }
+    }
+
+    void sub_column(std::int16_t *acc, unsigned int feature) const {
+        const std::int16_t *column = get_column(feature);
+#ifdef NETWORK_X86
+        if (use_avx2()) {return sub_column_avx2(acc, column);}
+#endif
+        for (unsigned int i = 0; i < hidden_size; i++) {
+            acc[i] = static_cast<std::int16_t>(acc[i] - column[i]);
+        }
+    }
+
+    // sub_column(from) then add_column(to) in one pass, for a piece that moved
+    void move_column(std::int16_t *acc, unsigned int from, unsigned int to) const {
+        const std::int16_t *from_column = get_column(from);
+        const std::int16_t *to_column = get_column(to);
+#ifdef NETWORK_X86
+        if (use_avx2()) {return move_column_avx2(acc, from_column, to_column);}
+#endif
+        for (unsigned int i = 0; i < hidden_size; i++) {
+            acc[i] = static_cast<std::int16_t>(acc[i] - from_column[i] + to_column[i]);
+        }
+    }
+
+    // The score for the player whose accumulator is ours
+    signed int propagate(const std::int16_t *ours, const std::int16_t *theirs) const {
+        std::array<std::uint8_t, 2 * hidden_size> inputs;
+        activate(ours, inputs.data());
+        activate(theirs, inputs.data() + hidden_size);
+
+        std::array<std::int32_t, l2_size> sums;
+        multiply_l2(inputs.data(), sums.data());
+
+        std::int32_t res = out_bias;
+        for (unsigned int i = 0; i < l2_size; i++) {
+            std::int32_t hidden = std::min(std::max((sums[i] + l2_biases[i]) >> l2_shift, 0), max_activation);
+            res += hidden * out_weights[i];
+        }
+        return res >> out_shift;
+    }
+
+private:
+    std::vector<std::int16_t> l1_weights;
+    std::array<std::int16_t, hidden_size> l1_biases;
+    std::array<std::int8_t, l2_size * 2 * hidden_size> l2_weights;
+    std::array<std::int32_t, l2_size> l2_biases;
+    std::array<std::int8_t, l2_size> out_weights;
+    std::int32_t out_bias;
+    std::uint32_t l2_shift;
+    std::uint32_t out_shift;
+
+    template <typename Type>
+    static void read_values(std::ifstream &file, Type *values, std::size_t count) {
+        file.read(reinterpret_cast<char *>(values), count * sizeof(Type));
+    }
+
+    template <typename Type>
+    static void write_values(std::ofstream &file, const Type *values, std::size_t count) {
+        file.write(reinterpret_cast<const char *>(values), count * sizeof(Type));
+    }
+
+    const std::int16_t *get_column(unsigned int feature) const {
+        return &l1_weights[feature * hidden_size];
+    }
+
+    static bool use_avx2() {
+        return CpuDispatch::get_active() != CpuDispatch::Isa::Scalar;
+    }
+
+    static void activate(const std::int16_t *acc, std::uint8_t *res) {
+#ifdef NETWORK_X86
+        if (use_avx2()) {return activate_avx2(acc, res);}
+#endif
+        for (unsigned int i = 0; i < hidden_size; i++) {
+            res[i] = static_cast<std::uint8_t>(std::min(std::max<signed int>(acc[i], 0), max_activation));
+        }
+    }
+
+    void multiply_l2(const std::uint8_t *inputs, std::int32_t *sums) const {
+#ifdef NETWORK_X86
+        if (use_avx2()) {return multiply_l2_avx2(inputs, sums);}
+#endif
+        for (unsigned int row = 0; row < l2_size; row++) {
+            const std::int8_t *weights = &l2_weights[row * 2 * hidden_size];
+            std::int32_t sum = 0;
+            for (unsigned int i = 0; i < 2 * hidden_size; i++) {
+                sum += inputs[i] * weights[i];
+            }
+            sums[row] = sum;
+        }
+    }
+
+#ifdef NETWORK_X86
+    static NETWORK_AVX2 void add_column_avx2(std::int16_t *acc, const std::int16_t *column) {
+        for (unsigned int i = 0; i < hidden_size; i += 16) {
+            __m256i *dst = reinterpret_cast<__m256i *>(acc + i);
+            _mm256_storeu_si256(dst, _mm256_add_epi16(_mm256_loadu_si256(dst), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(column + i))));
+        }
+    }
+
+    static NETWORK_AVX2 void sub_column_avx2(std::int16_t *acc, const std::int16_t *column) {
+        for (unsigned int i = 0; i < hidden_size; i += 16) {
+            __m256i *dst = reinterpret_cast<__m256i *>(acc + i);
+            _mm256_storeu_si256(dst, _mm256_sub_epi16(_mm256_loadu_si256(dst), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(column + i))));
+        }
+    }
+
+    static NETWORK_AVX2 void move_column_avx2(std::int16_t *acc, const std::int16_t *from_column, const std::int16_t *to_column) {
+        for (unsigned int i = 0; i < hidden_size; i += 16) {
+            __m256i *dst = reinterpret_cast<__m256i *>(acc + i);
+            __m256i from = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(from_column + i));
+            __m256i to = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(to_column + i));
+            _mm256_storeu_si256(dst, _mm256_add_epi16(_mm256_sub_epi16(_mm256_loadu_si256(dst), from), to));
+        }
+    }
+
+    static NETWORK_AVX2 void activate_avx2(const std::int16_t *acc, std::uint8_t *res) {
+        for (unsigned int i = 0; i < hidden_size; i += 32) {
+            __m256i max = _mm256_set1_epi16(max_activation);
+            __m256i lo = _mm256_min_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(acc + i)), max);
+            __m256i hi = _mm256_min_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(acc + i + 16)), max);
+            // Packing works within each 128-bit lane, so the quarters come out as lo, hi, lo, hi and need putting back in order
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(res + i), packed);
+        }
+    }
+
+    NETWORK_AVX2 void multiply_l2_avx2(const std::uint8_t *inputs, std::int32_t *sums) const {
+        static constexpr unsigned int input_regs = 2 * hidden_size / 32;
+        __m256i in[input_regs];
+        for (unsigned int i = 0; i < input_regs; i++) {
+            in[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(inputs + i * 32));
+        }
+
+        __m256i ones = _mm256_set1_epi16(1);
+        for (unsigned int row = 0; row < l2_size; row += 4) {
+            __m256i dots[4];
+            for (unsigned int j = 0; j < 4; j++) {
+                const std::int8_t *weights = &l2_weights[(row + j) * 2 * hidden_size];
+                dots[j] = _mm256_setzero_si256();
+                for (unsigned int i = 0; i < input_regs; i++) {
+                    __m256i pairs = _mm256_maddubs_epi16(in[i], _mm256_loadu_si256(reinterpret_cast<const __m256i *>(weights + i * 32)));
+                    dots[j] = _mm256_add_epi32(dots[j], _mm256_madd_epi16(pairs, ones));
+                }
+            }
+
+            // Adds up each row's eight lanes, four rows at once
+            __m256i sum = _mm256_hadd_epi32(_mm256_hadd_epi32(dots[0], dots[1]), _mm256_hadd_epi32(dots[2], dots[3]));
+            __m128i res = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(sums + row), res);
+        }
+    }
+#endif
+};
+
+// Both players' first layer sums for one board, indexed by absolute player
+// GameBoard's transitions keep it up to date with only the features the action changed, so it always equals refresh()
+// on the board it belongs to; integer adds wrap the same whatever order they come in
+struct NetworkAccumulator {
+    const Network *network;
+    std::array<std::array<std::int16_t, Network::hidden_size>, 2> values;
+    // The last slot of a stack, which has no room for a child after it
+    bool last;
+
+    // Biases and spawn features only, as if the board were empty
+    void reset(const Network &net) {
+        network = &net;
+        for (unsigned int player = 0; player < 2; player++) {
+            network->reset(values[player].data());
+            for (unsigned int owner = 0; owner < 2; owner++) {
+                network->add_column(values[player].data(), Network::get_spawn_feature(owner != player, 0));
+            }
+        }
+    }
+
+    template <typename Board>
+    void refresh(const Network &net, const Board &board) {
+        static constexpr unsigned int board_rad = Board::board_radius;
+
+        reset(net);
+        typename Board::SizedBitBoard remaining = board.pieces;
+        typename Board::SizedBitBoard::FastBitEater i;
+        while (remaining.has_bit(i)) {
+            unsigned int pos = remaining.pop_bit(i);
+            add_piece(board.kings.test(pos), board.teammates.test(pos) ? board.side : board.side ^ 1, Network::get_max_cell<board_rad>(pos));
+        }
+        change_spawns(board.side, 0, board.spawns[0]);
+        change_spawns(board.side ^ 1, 0, board.spawns[1]);
+    }
+
+    void add_piece(bool king, unsigned int owner, unsigned int max_cell) {
+        for (unsigned int player = 0; player < 2; player++) {
+            network->add_column(values[player].data(), Network::get_cell_feature(king, owner != player, max_cell));
+        }
+    }
+
+    void remove_piece(bool king, unsigned int owner, unsigned int max_cell) {
+        for (unsigned int player = 0; player < 2; player++) {
+            network->sub_column(values[player].data(), Network::get_cell_feature(king, owner != player, max_cell));
+        }
+    }
+
+    void move_piece(bool king, unsigned int owner, unsigned int src_max_cell, unsigned int dst_max_cell) {
+        for (unsigned int player = 0; player < 2; player++) {
+            bool theirs = owner != player;
+            network->move_column(values[player].data(), Network::get_cell_feature(king, theirs, src_max_cell), Network::get_cell_feature(king, theirs, dst_max_cell));
+        }
+    }
+
+    void change_spawns(unsigned int owner, unsigned int from, unsigned int to) {
+        if (Network::get_spawn_bucket(from) == Network::get_spawn_bucket(to)) {return;}
+        for (unsigned int player = 0; player < 2; player++) {
+            bool theirs = owner != player;
+            network->move_column(values[player].data(), Network::get_spawn_feature(theirs, from), Network::get_spawn_feature(theirs, to));
+        }
+    }
+
+    signed int propagate(unsigned int side) const {
+        return network->propagate(values[side].data(), values[side ^ 1].data());
+    }
+};
+
+// Scores boards of one size with a Network, from the accumulator the board carries when it has one
+// A search gives its root the first slot of a per-thread stack, and each child takes the slot after its parent's, so
+// the parent's stays as it was for the next sibling and a child costs a copy and the columns of the features that changed
+template <unsigned int board_rad>
+class NetworkEval {
+public:
+    typedef GameBoard<board_rad> Board;
+
+    // Enough for every ply of the deepest search plus quiescence; deeper boards just go without
+    static constexpr unsigned int max_plies = 128;
+
+    static void attach(const Network &network, Board &board) {
+        NetworkAccumulator *stack = get_stack();
+        stack[0].refresh(network, board);
+        board.accumulator = stack;
+    }
+
+    static signed int evaluate(const Network &network, const Board &board) {
+        if (!board.accumulator) {
+            NetworkAccumulator acc;
+            acc.refresh(network, board);
+            return acc.propagate(board.side);
+        }
+
+        assert(board.accumulator->network == &network);
+        assert(is_fresh(network, board));
+        return board.accumulator->propagate(board.side);
+    }
+
+    // Whether the board's accumulator matches one made from scratch, to check the transitions against
+    static bool is_fresh(const Network &network, const Board &board) {
+        NetworkAccumulator acc;
+        acc.refresh(network, board);
+        return board.accumulator->values == acc.values;
+    }
+
+private:
+    static NetworkAccumulator *get_stack() {
+        static thread_local std::array<NetworkAccumulator, max_plies> stack = make_stack();
+        return stack.data();
+    }
+
+    static std::array<NetworkAccumulator, max_plies> make_stack() {
+        std::array<NetworkAccumulator, max_plies> res;
+        for (NetworkAccumulator &acc : res) {
+            acc.network = 0;
+            acc.last = false;
+        }
+        res.back().last = true;
+        return res;
+    }
+};
+
+#endif // NETWORK_H
@@ -0,0 +1,250 @@
+#ifndef PERFT_H
+#define PERFT_H
+
+#include <array>
+#include <vector>
+#include <atomic>
+#include <thread>
+
+#include "turnstate.h"
+#include "actionlog.h"
+#include "moveorder.h"
+#include "actiongen.h"
+#include "gridcode.h"
+
+// Counts what the action generator produces, without any evaluation or pruning
+// Depth is in turns; a turn is any number of actions and then ending it
+template <typename MiniMaxType>
+class Perft {
+public:
+    typedef typename MiniMaxType::Board Board;
+
+    static constexpr unsigned int num_types = static_cast<unsigned int>(ActionType::EndTurn) + 1;
+
+    struct Counts {
+        // Turns ending at the last depth
+        unsigned long long turns = 0;
+        // Actions played during the last turn, by type; EndTurn matches turns
+        std::array<unsigned long long, num_types> actions = {};
+        // Positions reached where the side to move can take the enemy king, which end the game
+        unsigned long long wins = 0;
+
+        void add(const Counts &other) {
+            turns += other.turns;
+            for (unsigned int i = 0; i < num_types; i++) {
+                actions[i] += other.actions[i];
+            }
+            wins += other.wins;
+        }
+
+        bool operator==(const Counts &other) const {
+            return turns == other.turns && actions == other.actions && wins == other.wins;
+        }
+    };
+
+    struct Divide {
+        Action action;
+        Counts counts;
+    };
+
+    // A known count for one of the web game's standard formations, checked by --perft-check
+    struct Reference {
+        const char *name;
+        const char *formation;
+        unsigned int spawns;
+        unsigned int depth;
+        unsigned long long turns;
+    };
+
+    static Counts count(const Board &board, unsigned int depth) {
+        Counts res;
+        if (depth == 0) {
+            res.turns = 1;
+            return res;
+        }
+        walk<TurnState_Initial>(board, depth, res);
+        return res;
+    }
+
+    // Counts below each first action of the root turn, with the root actions shared out between threads
+    static std::vector<Divide> divide(const Board &board, unsigned int depth, unsigned int num_threads, Counts &total) {
+        total = Counts();
+        std::vector<Divide> res;
+        if (depth == 0) {
+            total.turns = 1;
+            return res;
+        }
+
+        ActionList actions;
+        if (!gen_all<TurnState_Initial>(board, actions)) {
+            total.wins++;
+            return res;
+        }
+
+        // Ending the turn straight away isn't an action, so it has to be counted here
+        if (TurnState_Initial::can_end) {
+            end_turn(board, depth, total);
+        }
+
+        res.resize(actions.size());
+        for (unsigned int i = 0; i < actions.size(); i++) {
+            res[i].action = actions.get(i);
+        }
+
+        std::atomic<unsigned int> next(0);
+        auto work = [&]() {
+            unsigned int i;
+            while ((i = next.fetch_add(1)) < res.size()) {
+                expand<TurnState_Initial>(board, res[i].action, depth, res[i].counts);
+            }
+        };
+
+        std::vector<std::thread> helpers;
+        for (unsigned int i = 1; i < num_threads; i++) {
+            helpers.emplace_back(work);
+        }
+        work();
+        for (std::thread &helper : helpers) {
+            helper.join();
+        }
+
+        for (const Divide &entry : res) {
+            total.add(entry.counts);
+        }
+        return res;
+    }
+
+    // Counts for the web game's presets on its default radius 5 board
+    // Kept small enough to run in a few seconds with an unoptimized build
+    static const std::vector<Reference> &get_references() {
+        static const std::vector<Reference> references = {
+            {"Shield", "5,3,e,e,e,e,e,e,n,e,e,e,n,e,e,n,n,n,e,e,n,e,k,e,e,e,n,e,n,n,e,n,n,e,e", 0, 1, 40},
+            {"Shield", "5,3,e,e,e,e,e,e,n,e,e,e,n,e,e,n,n,n,e,e,n,e,k,e,e,e,n,e,n,n,e,n,n,e,e", 0, 2, 1582},
+            {"Shield", "5,3,e,e,e,e,e,e,n,e,e,e,n,e,e,n,n,n,e,e,n,e,k,e,e,e,n,e,n,n,e,n,n,e,e", 0, 3, 62218},
+            {"Shield", "5,3,e,e,e,e,e,e,n,e,e,e,n,e,e,n,n,n,e,e,n,e,k,e,e,e,n,e,n,n,e,n,n,e,e", 0, 4, 2423388},
+            {"Spawn from king", "3,3,e,e,e,e,e,e,e,k", 10, 1, 12},
+            {"Spawn from king", "3,3,e,e,e,e,e,e,e,k", 10, 2, 144},
+            {"Spawn from king", "3,3,e,e,e,e,e,e,e,k", 10, 3, 1944},
+            {"Spawn from king", "3,3,e,e,e,e,e,e,e,k", 10, 4, 26058},
+        };
+        return references;
+    }
+
+private:
+    // Collects every action of this turn state, or returns false if the side to move can take the enemy king
+    template <typename TurnState>
+    static bool gen_all(const Board &board, ActionList &actions) {
+        ActionGen<MiniMaxType, TurnState> gen(board, Action(), 0, 0);
+        Action action;
+        while (gen.next(action)) {
+            actions.add(action.type, action.src, action.dst);
+        }
+        return !gen.found_win();
+    }
+
+    static void end_turn(const Board &board, unsigned int depth, Counts &counts) {
+        if (depth == 1) {
+            counts.turns++;
+            counts.actions[static_cast<unsigned int>(ActionType::EndTurn)]++;
+        } else {
+            walk<TurnState_Initial>(board.template flip_teams<Board>(), depth - 1, counts);
+        }
+    }
+
+    template <typename TurnState>
+    static void walk(const Board &board, unsigned int depth, Counts &counts) {
+        ActionList actions;
+        if (!TurnState::must_end && !gen_all<TurnState>(board, actions)) {
+            counts.wins++;
+            return;
+        }
+
+        if (TurnState::can_end) {
+            end_turn(board, depth, counts);
+        }
+
+        for (unsigned int i = 0; i < actions.size(); i++) {
+            expand<TurnState>(board, actions.get(i), depth, counts);
+        }
+    }
+
+    template <typename TurnState>
+    static void expand(const Board &board, const Action &action, unsigned int depth, Counts &counts) {
+        if (depth == 1) {
+            counts.actions[static_cast<unsigned int>(action.type)]++;
+        }
+
+        // Same transitions as MiniMax::expand
+        switch (action.type) {
+            case ActionType::Move: walk<typename TurnState::AfterMove>(board.move(action.src, action.dst), depth, counts); break;
+            case ActionType::Jump: walk<typename TurnState::AfterJump>(board.jump(action.src, action.dst), depth, counts); break;
+            case ActionType::Glide: walk<typename TurnState::AfterJump>(board.glide(action.src, action.dst), depth, counts); break;
+            case ActionType::Spawn: walk<typename TurnState::AfterSpawn>(board.spawn(action.dst), depth, counts); break;
+            default: assert(false); break;
+        }
+    }
+};
+
+// The same counts for MultiMiniMax's generator, where every turn is a single action
+// Taking the last king of the only other player left is found as a win, as in the two player game, and a player
+// with no actions ends the line without a turn (the search passes instead, but there's no generated action to count)
+template <typename MultiMiniMaxType>
+class MultiPerft {
+public:
+    typedef typename MultiMiniMaxType::Board Board;
+    typedef Perft<typename MultiMiniMaxType::Geometry> TwoPlayerPerft;
+    typedef typename TwoPlayerPerft::Counts Counts;
+    typedef typename TwoPlayerPerft::Reference Reference;
+
+    static constexpr unsigned int num_types = TwoPlayerPerft::num_types;
+
+    static Counts count(const Board &board, unsigned int depth) {
+        Counts res;
+        if (depth == 0) {
+            res.turns = 1;
+            return res;
+        }
+        walk(board, depth, res);
+        return res;
+    }
+
+    // Counts for three player formations on the default radius 5 board, from this generator, so only a regression check
+    static const std::vector<Reference> &get_references() {
+        static const std::vector<Reference> references = {
+            {"Three kings", "4,2,e,e,n,n,e,k,n,e,e,e,n,e,e,n", 1, 1, 25},
+            {"Three kings", "4,2,e,e,n,n,e,k,n,e,e,e,n,e,e,n", 1, 2, 623},
+            {"Three kings", "4,2,e,e,n,n,e,k,n,e,e,e,n,e,e,n", 1, 3, 15574},
+            {"Three kings", "4,2,e,e,n,n,e,k,n,e,e,e,n,e,e,n", 1, 4, 411550},
+        };
+        return references;
+    }
+
+private:
+    static void walk(const Board &board, unsigned int depth, Counts &counts) {
+        ActionList actions;
+        MultiMiniMaxType::gen_actions(board, actions);
+
+        for (unsigned int i = 0; i < actions.size(); i++) {
+            Action action = actions.get(i);
+            if (action.type == ActionType::Jump && board.apply(action).get_winner() == board.to_move) {
+                counts.wins++;
+                return;
+            }
+        }
+
+        for (unsigned int i = 0; i < actions.size(); i++) {
+            Action action = actions.get(i);
+            if (depth == 1) {
+                counts.turns++;
+                counts.actions[static_cast<unsigned int>(action.type)]++;
+                counts.actions[static_cast<unsigned int>(ActionType::EndTurn)]++;
+            } else {
+                Board child = board.apply(action);
+                child.next_turn();
+                walk(child, depth - 1, counts);
+            }
+        }
+    }
+};
+
+#endif // PERFT_H
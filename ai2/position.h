@@ -0,0 +1,197 @@
+#ifndef POSITION_H
+#define POSITION_H
+
+#include <string>
+#include <vector>
+#include <array>
+#include <sstream>
+
+#include "actionlog.h"
+
+// One line of text per position, for suites of test positions:
+//
+//   <rows> <side> <o spawns> <x spawns> [; <op> <args>]...
+//
+// rows are top to bottom and separated by '/', with one character per column:
+// '.' is off the board, '+' empty, 'o'/'O' a piece/king of side 0 and 'x'/'X' the same for side 1.
+// A side can have more than one king.
+// side is 'o' or 'x', whichever moves next.
+// The ops say what a search should find:
+//   bm <type> <src> <dst>   a best first action (may be given more than once)
+//   score <n>               the exact score
+//   id <name>               a name for reports, without spaces
+template <typename MiniMaxType>
+class PositionCode {
+public:
+    typedef typename MiniMaxType::Board Board;
+    typedef typename MiniMaxType::SizedBitBoard SizedBitBoard;
+
+    static constexpr unsigned int board_diam = MiniMaxType::board_diam;
+
+    struct Position {
+        Board board;
+        std::string id;
+        std::vector<Action> best_actions;
+        bool has_score = false;
+        signed int score = 0;
+
+        bool has_expectation() const {
+            return !best_actions.empty() || has_score;
+        }
+
+        bool matches(signed int found_score, const Action &found_action) const {
+            if (has_score && found_score != score) {return false;}
+            if (best_actions.empty()) {return true;}
+            for (const Action &action : best_actions) {
+                if (action == found_action) {return true;}
+            }
+            return false;
+        }
+    };
+
+    static bool parse(const std::string &line, Position &res, std::string &error) {
+        std::vector<std::string> fields = split(line, ';');
+        if (fields.empty() || !parse_board(fields[0], res.board, error)) {
+            if (error.empty()) {error = "Missing board";}
+            return false;
+        }
+
+        for (unsigned int i = 1; i < fields.size(); i++) {
+            std::istringstream stream(fields[i]);
+            std::string op;
+            if (!(stream >> op)) {continue;}
+
+            if (op == "bm") {
+                std::string type_name;
+                unsigned int src;
+                unsigned int dst;
+                ActionType type;
+                if (!(stream >> type_name >> src >> dst) || !parse_type(type_name, type)) {
+                    error = "Bad bm: " + fields[i];
+                    return false;
+                }
+                res.best_actions.emplace_back(type, src, dst);
+            } else if (op == "score") {
+                if (!(stream >> res.score)) {
+                    error = "Bad score: " + fields[i];
+                    return false;
+                }
+                res.has_score = true;
+            } else if (op == "id") {
+                stream >> res.id;
+            } else {
+                error = "Unknown op: " + op;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    static bool parse_board(const std::string &field, Board &board, std::string &error) {
+        std::istringstream stream(field);
+        std::string rows_code;
+        std::string side_code;
+        std::array<unsigned int, 2> spawns;
+        if (!(stream >> rows_code >> side_code >> spawns[0] >> spawns[1]) || (side_code != "o" && side_code != "x")) {
+            error = "Expected <rows> <side> <o spawns> <x spawns>";
+            return false;
+        }
+
+        std::vector<std::string> rows = split(rows_code, '/');
+        if (rows.size() != board_diam) {
+            error = "Expected " + std::to_string(board_diam) + " rows, got " + std::to_string(rows.size());
+            return false;
+        }
+
+        SizedBitBoard empties = SizedBitBoard::from_bits();
+        std::array<SizedBitBoard, 2> teams = {{SizedBitBoard::from_bits(), SizedBitBoard::from_bits()}};
+        std::array<SizedBitBoard, 2> kings = {{SizedBitBoard::from_bits(), SizedBitBoard::from_bits()}};
+
+        for (unsigned int row = 0; row < board_diam; row++) {
+            if (rows[row].size() != board_diam) {
+                error = "Row " + std::to_string(row) + " should have " + std::to_string(board_diam) + " cells";
+                return false;
+            }
+
+            for (unsigned int col = 0; col < board_diam; col++) {
+                unsigned int cell = MiniMaxType::lookup_cell_id(row, col);
+                char c = rows[row][col];
+                switch (c) {
+                    case '.': break;
+                    case '+': empties |= SizedBitBoard::from_bits(cell); break;
+                    case 'O': kings[0] |= SizedBitBoard::from_bits(cell); // fall through
+                    case 'o': teams[0] |= SizedBitBoard::from_bits(cell); break;
+                    case 'X': kings[1] |= SizedBitBoard::from_bits(cell); // fall through
+                    case 'x': teams[1] |= SizedBitBoard::from_bits(cell); break;
+                    default:
+                        error = std::string("Unknown cell '") + c + "'";
+                        return false;
+                }
+            }
+        }
+
+        if (!kings[0].has_bit() || !kings[1].has_bit()) {
+            error = "Both sides need a king";
+            return false;
+        }
+
+        // The board is kept from the point of view of the side to move
+        unsigned int side = side_code == "o" ? 0 : 1;
+        unsigned int other = 1 - side;
+        board = Board(empties, teams[0] | teams[1], teams[side], kings[0] | kings[1], {{spawns[side], spawns[other]}}, side);
+        return true;
+    }
+
+    static std::string to_code(const Board &board) {
+        // Undo the point of view, so 'o' is always side 0
+        bool o_to_move = board.side == 0;
+
+        std::string res;
+        for (unsigned int row = 0; row < board_diam; row++) {
+            if (row) {res += '/';}
+            for (unsigned int col = 0; col < board_diam; col++) {
+                unsigned int cell = MiniMaxType::lookup_cell_id(row, col);
+                if (board.pieces.test(cell)) {
+                    bool is_o = board.teammates.test(cell) == o_to_move;
+                    bool king = board.kings.test(cell);
+                    res += is_o ? (king ? 'O' : 'o') : (king ? 'X' : 'x');
+                } else {
+                    res += board.empties.test(cell) ? '+' : '.';
+                }
+            }
+        }
+
+        res += o_to_move ? " o " : " x ";
+        res += std::to_string(board.spawns[o_to_move ? 0 : 1]) + ' ' + std::to_string(board.spawns[o_to_move ? 1 : 0]);
+        return res;
+    }
+
+private:
+    static std::vector<std::string> split(const std::string &str, char sep) {
+        std::vector<std::string> res;
+        std::string cur;
+        for (char c : str) {
+            if (c == sep) {
+                res.push_back(cur);
+                cur.clear();
+            } else {
+                cur += c;
+            }
+        }
+        res.push_back(cur);
+        return res;
+    }
+
+    static bool parse_type(const std::string &name, ActionType &type) {
+        for (unsigned int i = 0; i <= static_cast<unsigned int>(ActionType::EndTurn); i++) {
+            if (name == Action::get_type_name(static_cast<ActionType>(i))) {
+                type = static_cast<ActionType>(i);
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+#endif // POSITION_H
@@ -0,0 +1,73 @@
+#ifndef PVTABLE_H
+#define PVTABLE_H
+
+#include <cstdint>
+#include <array>
+
+#include "actionlog.h"
+
+// Triangular table of principal variations, one row per ply
+// A node's row is its best turn followed by the row of the ply below, copied as soon as that turn comes back best,
+// so the root's row ends up holding the whole line; turns are closed by an EndTurn action
+// Rows shrink with the ply and everything is preallocated, so keeping it up to date never allocates
+class PvTable {
+public:
+    static constexpr unsigned int max_ply = 64;
+    static constexpr unsigned int max_turn_actions = 3;
+    static constexpr unsigned int turn_stride = max_turn_actions + 1;
+    static constexpr unsigned int table_size = turn_stride * max_ply * (max_ply + 1) / 2;
+
+    // Nodes call this on entry, so a child cut off by the table or the horizon leaves no stale line behind
+    void clear(unsigned int ply) {
+        if (ply < max_ply) {lengths[ply] = 0;}
+    }
+
+    void update(unsigned int ply, const Action *turn, unsigned int turn_length) {
+        if (ply >= max_ply) {return;}
+
+        std::uint32_t *row = &actions[get_row_start(ply)];
+        unsigned int length = 0;
+        for (unsigned int i = 0; i < turn_length; i++) {
+            row[length++] = turn[i].pack();
+        }
+        row[length++] = Action(ActionType::EndTurn, 0, 0).pack();
+
+        if (ply + 1 < max_ply) {
+            const std::uint32_t *next = &actions[get_row_start(ply + 1)];
+            for (unsigned int i = 0; i < lengths[ply + 1]; i++) {
+                row[length++] = next[i];
+            }
+        }
+
+        lengths[ply] = length;
+    }
+
+    unsigned int get_length(unsigned int ply) const {
+        return ply < max_ply ? lengths[ply] : 0;
+    }
+
+    Action get(unsigned int ply, unsigned int i) const {
+        return Action::unpack(actions[get_row_start(ply) + i]);
+    }
+
+    // Allocates, so only call it between searches
+    ActionLog get_line(unsigned int ply) const {
+        ActionLog res;
+        for (unsigned int i = 0; i < get_length(ply); i++) {
+            Action action = get(ply, i);
+            res.add_action(action.type, action.src, action.dst);
+        }
+        return res;
+    }
+
+private:
+    // Row ply has room for the turns of every ply from it to max_ply
+    static unsigned int get_row_start(unsigned int ply) {
+        return turn_stride * (ply * max_ply - ply * (ply - 1) / 2);
+    }
+
+    std::array<std::uint32_t, table_size> actions;
+    std::array<unsigned int, max_ply> lengths = {};
+};
+
+#endif // PVTABLE_H
@@ -0,0 +1,247 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdlib>
+#include <new>
+#include <random>
+
+#include "turnstate.h"
+#include "minimax.h"
+#include "position.h"
+#include "gridcode.h"
+#include "network.h"
+#include "evaluationbatch.h"
+#include "cpudispatch.h"
+
+// Checks that don't fit into --perft-check or a suite, one line per check and exit status 1 if any fails
+// Build with make_test.sh; it replaces the global allocator, which the ai2 binary itself never does
+
+typedef MiniMax<4, true> Algorithm;
+typedef PositionCode<Algorithm> AlgorithmPositionCode;
+
+static thread_local unsigned long long allocations;
+
+void *operator new(std::size_t size) {
+    allocations++;
+    void *res = std::malloc(size ? size : 1);
+    if (!res) {throw std::bad_alloc();}
+    return res;
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void *operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete[](void *ptr) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept {
+    operator delete(ptr);
+}
+
+static bool report(bool ok, const std::string &name, const std::string &details) {
+    std::cout << (ok ? "ok   " : "FAIL ") << name << ' ' << details << std::endl;
+    return ok;
+}
+
+static bool load_position(const std::string &line, Algorithm::Board &board) {
+    AlgorithmPositionCode::Position pos;
+    std::string error;
+    if (!AlgorithmPositionCode::parse(line, pos, error)) {
+        std::cerr << error << std::endl;
+        return false;
+    }
+    board = pos.board;
+    return true;
+}
+
+// The tree search works out of preallocated tables only, so it must not allocate on any thread
+// Every thread searches the same root at once through the shared transposition table, like the helpers of a search
+static bool test_search_allocations(unsigned int num_threads) {
+    static constexpr unsigned int depth = 6;
+
+    Algorithm::Board board;
+    if (!load_position("....+++++/...+++X++/..++++x++/.++++++++/+++++++++/++++++++./+o+o+++../++O+++.../oo+++.... o 0 3", board)) {return false;}
+
+    MiniMaxShared::transposition_table.clear();
+    MiniMaxShared::stop.store(false);
+
+    std::vector<unsigned long long> counts(num_threads);
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < num_threads; i++) {
+        threads.emplace_back([&board, &counts, i]() {
+            // A search sets up its per-thread tables before the tree search starts, and so does this
+            MiniMaxShared::get_move_order<Algorithm::num_cells>().new_search();
+
+            unsigned long long before = allocations;
+            Algorithm alg(depth + 1);
+            alg.calc_score(board);
+            counts[i] = allocations - before;
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    unsigned long long total = 0;
+    for (unsigned long long count : counts) {
+        total += count;
+    }
+    return report(total == 0, "search_allocations", "threads " + std::to_string(num_threads) + " depth " + std::to_string(depth) + " allocations " + std::to_string(total));
+}
+
+// The web game plays 'v' cells like 'n' ones, so a code made of them is the plain board, while walls take cells away
+static bool test_board_code_void_cells() {
+    Algorithm::SizedBitBoard plain;
+    Algorithm::SizedBitBoard voids;
+    Algorithm::SizedBitBoard walled;
+    std::string error;
+    if (!GridCode<Algorithm>::load_board("5", plain, error)
+            || !GridCode<Algorithm>::load_board("5,6,v,v,v,v,v,v,v,v,v,v", voids, error)
+            || !GridCode<Algorithm>::load_board("5,6,v,w,v,v", walled, error)) {
+        return report(false, "board_code_void_cells", error);
+    }
+
+    unsigned int board_rad = 0;
+    HexGrid::get_fit_radius("5,6,v,v,v,v,v,v,v,v,v,v", board_rad, error);
+
+    // Every sector starts at the center, so the wall goes on the next cell, which only the first sector has
+    bool ok = voids == plain && board_rad == 4 && walled == (plain & ~Algorithm::SizedBitBoard::from_bits(Algorithm::lookup_cell_id(4, 5)));
+    return report(ok, "board_code_void_cells", "cells " + std::to_string(voids.count_set_bits()) + " of " + std::to_string(plain.count_set_bits())
+                  + " walled " + std::to_string(walled.count_set_bits()) + " radius " + std::to_string(board_rad));
+}
+
+// Every transition updates the network's accumulator by the features its action changed, which has to come to the same as
+// starting over, however the children are made and however far back they're unmade
+static bool test_network_accumulator() {
+    static constexpr unsigned int num_games = 32;
+    static constexpr unsigned int max_actions = 60;
+    // One spawn each, so a king's jump or a spawn moves its side to another spawn bucket
+    const std::string start = "....+++++/...+++X++/..++++x++/.++++++++/+++++++++/++++++++./+o+o+++../++O+++.../oo+++.... o 1 1";
+
+    Network network = Network::make_random(1);
+    std::mt19937 rng(1);
+    unsigned int checks = 0;
+    unsigned int failures = 0;
+
+    for (unsigned int game = 0; game < num_games; game++) {
+        Algorithm::Board board;
+        if (!load_position(start, board)) {return false;}
+        NetworkEval<4>::attach(network, board);
+
+        std::vector<Algorithm::Board::Undo> undos;
+        std::vector<Algorithm::Board> before;
+        for (unsigned int i = 0; i < max_actions; i++) {
+            // Takes back one of the in place actions now and then, to check the parent's accumulator is as it was
+            if (!undos.empty() && rng() % 4 == 0) {
+                board.flip();
+                board.unmake(undos.back());
+                failures += !(board == before.back());
+                undos.pop_back();
+                before.pop_back();
+            } else {
+                std::vector<Action> actions;
+                ActionGen<Algorithm, TurnState_Initial> gen(board, Action(), 0, 0);
+                Action action;
+                while (gen.next(action)) {
+                    actions.push_back(action);
+                }
+                if (gen.found_win() || actions.empty()) {break;}
+
+                action = actions[rng() % actions.size()];
+                if (rng() % 2) {
+                    before.push_back(board);
+                    undos.push_back(board.make(action));
+                    board.flip();
+                } else {
+                    // A copy can't be unmade into the boards before it
+                    board = board.apply(action).template flip_teams<Algorithm::Board>();
+                    undos.clear();
+                    before.clear();
+                }
+            }
+
+            checks++;
+            failures += !board.accumulator || !NetworkEval<4>::is_fresh(network, board);
+        }
+    }
+
+    return report(failures == 0, "network_accumulator", "checks " + std::to_string(checks) + " failures " + std::to_string(failures));
+}
+
+// EvaluationBatch has to give Evaluation's positional score for every board of a batch, on every instruction set
+static bool test_evaluation_batch() {
+    static constexpr unsigned int num_boards = 512;
+    static constexpr unsigned int max_boards = EvaluationBatch<Algorithm>::max_boards;
+    const std::string start = "....+++++/...+++X++/..++++x++/.++++++++/+++++++++/++++++++./+o+o+++../++O+++.../oo+++.... o 1 1";
+
+    // Boards from random games, which get crowded with gliders as they go on
+    std::vector<Algorithm::Board> boards;
+    std::mt19937 rng(2);
+    Algorithm::Board board;
+    if (!load_position(start, board)) {return false;}
+    while (boards.size() < num_boards) {
+        std::vector<Action> actions;
+        ActionGen<Algorithm, TurnState_Initial> gen(board, Action(), 0, 0);
+        Action action;
+        while (gen.next(action)) {
+            actions.push_back(action);
+        }
+        if (gen.found_win() || actions.empty()) {
+            load_position(start, board);
+            continue;
+        }
+
+        board = board.apply(actions[rng() % actions.size()]).template flip_teams<Algorithm::Board>();
+        boards.push_back(board);
+    }
+
+    CpuDispatch::Isa active = CpuDispatch::get_active();
+    unsigned int failures = 0;
+    std::string isas;
+    for (CpuDispatch::Isa isa : {CpuDispatch::Isa::Scalar, CpuDispatch::get_best()}) {
+        CpuDispatch::set_active(isa);
+        isas += std::string(" ") + CpuDispatch::get_name(isa);
+
+        // Batches of every size, so leftover columns from the batch before get through too
+        EvaluationBatch<Algorithm> batch;
+        unsigned int i = 0;
+        while (i < boards.size()) {
+            batch.clear();
+            unsigned int size = 1 + i % max_boards;
+            for (unsigned int j = 0; j < size && i + j < boards.size(); j++) {
+                batch.add(boards[i + j]);
+            }
+
+            std::array<signed int, max_boards> scores;
+            batch.calc_positional_scores(scores.data());
+            for (unsigned int j = 0; j < batch.size(); j++) {
+                failures += scores[j] != Evaluation<Algorithm>::calc_positional_score(boards[i + j]);
+            }
+            i += batch.size();
+        }
+    }
+    CpuDispatch::set_active(active);
+
+    return report(failures == 0, "evaluation_batch", "boards " + std::to_string(num_boards) + " isas" + isas + " failures " + std::to_string(failures));
+}
+
+int main() {
+    bool ok = true;
+    ok &= test_board_code_void_cells();
+    ok &= test_network_accumulator();
+    ok &= test_evaluation_batch();
+    ok &= test_search_allocations(1);
+    ok &= test_search_allocations(4);
+    return ok ? 0 : 1;
+}
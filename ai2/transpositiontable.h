@@ -0,0 +1,254 @@
+#ifndef TRANSPOSITIONTABLE_H
+#define TRANSPOSITIONTABLE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <atomic>
+#include <mutex>
+#include <limits.h>
+#include <assert.h>
+
+#include "actionlog.h"
+
+// Fixed-size hash table of search results, bucketed so each probe touches a single cache line.
+// Safe to share between search threads without locks: each entry stores its key xored with its data,
+// so an entry torn by two threads writing at once just fails to match.
+class TranspositionTable {
+public:
+    enum class Bound : unsigned int {None, Exact, Lower, Upper};
+
+    struct Data {
+        signed int score;
+        unsigned int depth;
+        Bound bound;
+        Action action;
+    };
+
+    struct Stats {
+        // Probes that found the position
+        unsigned long long hits = 0;
+        // Probes that didn't
+        unsigned long long misses = 0;
+        // Stores into a full bucket that evicted a different position
+        unsigned long long collisions = 0;
+        // Stores that replaced an older result for the same position
+        unsigned long long overwrites = 0;
+
+        void add(const Stats &other) {
+            hits += other.hits;
+            misses += other.misses;
+            collisions += other.collisions;
+            overwrites += other.overwrites;
+        }
+    };
+
+    static constexpr unsigned int max_depth = 63;
+
+    TranspositionTable() {
+        resize(16);
+    }
+
+    void resize(std::size_t megabytes) {
+        num_buckets = megabytes * 1024 * 1024 / sizeof(Bucket);
+        if (num_buckets == 0) {num_buckets = 1;}
+
+        // new[] only promises alignof(std::max_align_t) before C++17, so the buckets are built in place on a cache line
+        storage.reset(new unsigned char[num_buckets * sizeof(Bucket) + alignof(Bucket)]);
+        std::uintptr_t addr = reinterpret_cast<std::uintptr_t>(storage.get());
+        addr = (addr + alignof(Bucket) - 1) & ~static_cast<std::uintptr_t>(alignof(Bucket) - 1);
+        buckets = reinterpret_cast<Bucket *>(addr);
+        for (std::size_t i = 0; i < num_buckets; i++) {
+            new (&buckets[i]) Bucket();
+        }
+
+        clear();
+    }
+
+    void clear() {
+        for (std::size_t i = 0; i < num_buckets; i++) {
+            for (unsigned int j = 0; j < Bucket::size; j++) {
+                buckets[i].entries[j].write(0, 0);
+            }
+        }
+        age = 0;
+
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        stats = Stats();
+    }
+
+    // Entries from older searches are replaced first
+    void new_search() {
+        age = (age + 1) & age_mask;
+    }
+
+    std::size_t get_size_bytes() const {
+        return num_buckets * sizeof(Bucket);
+    }
+
+    Stats get_stats() {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        return stats;
+    }
+
+    // Each search thread counts into its own stats, and adds them here when it's done
+    void add_stats(const Stats &thread_stats) {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        stats.add(thread_stats);
+    }
+
+    bool probe(std::uint64_t key, Data &data, Stats &stats) {
+        Bucket &bucket = get_bucket(key);
+        for (unsigned int i = 0; i < Bucket::size; i++) {
+            Entry entry = bucket.entries[i].read();
+            if (entry.key == key && entry.get_bound() != Bound::None) {
+                if (entry.get_age() != age) {
+                    entry.set_age(age);
+                    bucket.entries[i].write(entry.key, entry.data);
+                }
+                data = entry.get_data();
+                stats.hits++;
+                return true;
+            }
+        }
+        stats.misses++;
+        return false;
+    }
+
+    void store(std::uint64_t key, signed int score, unsigned int depth, Bound bound, Action action, Stats &stats) {
+        assert(bound != Bound::None);
+        if (depth > max_depth) {depth = max_depth;}
+
+        Bucket &bucket = get_bucket(key);
+
+        // Work on a snapshot, since other threads may be writing the bucket meanwhile
+        Entry entries[Bucket::size];
+        for (unsigned int i = 0; i < Bucket::size; i++) {
+            entries[i] = bucket.entries[i].read();
+        }
+
+        unsigned int replace = Bucket::size;
+        signed int replace_worth = INT_MAX;
+        for (unsigned int i = 0; i < Bucket::size; i++) {
+            Entry &entry = entries[i];
+
+            if (entry.get_bound() == Bound::None) {
+                if (replace == Bucket::size || entries[replace].get_bound() != Bound::None) {
+                    replace = i;
+                    replace_worth = -1;
+                }
+                continue;
+            }
+
+            if (entry.key == key) {
+                // Keep a deeper result for this position unless the new one is exact
+                Data old = entry.get_data();
+                if (depth + 2 < old.depth && bound != Bound::Exact) {
+                    if (!action.pack()) {return;}
+                    old.action = action;
+                    entry.set_data(old, age);
+                    bucket.entries[i].write(key, entry.data);
+                    return;
+                }
+                if (!action.pack()) {action = old.action;}
+
+                entry.set_data(Data{score, depth, bound, action}, age);
+                bucket.entries[i].write(key, entry.data);
+                stats.overwrites++;
+                return;
+            }
+
+            // Prefer evicting shallow entries and entries from old searches
+            signed int worth = static_cast<signed int>(entry.get_depth()) - static_cast<signed int>(((age - entry.get_age()) & age_mask) * 8);
+            if (worth < replace_worth) {
+                replace = i;
+                replace_worth = worth;
+            }
+        }
+
+        if (entries[replace].get_bound() != Bound::None) {
+            stats.collisions++;
+        }
+        Entry &entry = entries[replace];
+        entry.set_data(Data{score, depth, bound, action}, age);
+        bucket.entries[replace].write(key, entry.data);
+    }
+
+private:
+    static constexpr unsigned int age_mask = 7;
+
+    // A decoded entry: the full key, and everything else packed as
+    // score:32 | action:21 | depth:6 | bound:2 | age:3
+    struct Entry {
+        std::uint64_t key = 0;
+        std::uint64_t data = 0;
+
+        Data get_data() const {
+            Data res;
+            res.score = static_cast<std::int32_t>(static_cast<std::uint32_t>(data));
+            res.action = Action::unpack((data >> 32) & ((1u << Action::packed_bits) - 1));
+            res.depth = get_depth();
+            res.bound = get_bound();
+            return res;
+        }
+
+        void set_data(const Data &d, unsigned int age) {
+            data = static_cast<std::uint32_t>(d.score)
+                | (static_cast<std::uint64_t>(d.action.pack()) << 32)
+                | (static_cast<std::uint64_t>(d.depth) << 53)
+                | (static_cast<std::uint64_t>(d.bound) << 59)
+                | (static_cast<std::uint64_t>(age) << 61);
+        }
+
+        unsigned int get_depth() const {return (data >> 53) & 63;}
+        Bound get_bound() const {return static_cast<Bound>((data >> 59) & 3);}
+        unsigned int get_age() const {return data >> 61;}
+
+        void set_age(unsigned int age) {
+            data = (data & ~(static_cast<std::uint64_t>(age_mask) << 61)) | (static_cast<std::uint64_t>(age) << 61);
+        }
+    };
+
+    // How an entry is kept in the table
+    // Relaxed atomics are enough, since a half-written entry is caught by the xor rather than by ordering
+    struct SharedEntry {
+        std::atomic<std::uint64_t> key_xor_data;
+        std::atomic<std::uint64_t> data;
+
+        Entry read() const {
+            Entry res;
+            res.data = data.load(std::memory_order_relaxed);
+            res.key = key_xor_data.load(std::memory_order_relaxed) ^ res.data;
+            return res;
+        }
+
+        void write(std::uint64_t key, std::uint64_t new_data) {
+            key_xor_data.store(key ^ new_data, std::memory_order_relaxed);
+            data.store(new_data, std::memory_order_relaxed);
+        }
+    };
+
+    struct alignas(64) Bucket {
+        static constexpr unsigned int size = 4;
+        SharedEntry entries[size];
+    };
+
+    // Buckets are never destroyed, just dropped with storage
+    static_assert(std::is_trivially_destructible<Bucket>::value, "Buckets need destroying");
+
+    std::unique_ptr<unsigned char[]> storage;
+    Bucket *buckets;
+    std::size_t num_buckets;
+    unsigned int age;
+
+    std::mutex stats_mutex;
+    Stats stats;
+
+    Bucket &get_bucket(std::uint64_t key) {
+        return buckets[static_cast<std::size_t>((static_cast<unsigned __int128>(key) * num_buckets) >> 64)];
+    }
+};
+
+#endif // TRANSPOSITIONTABLE_H
@@ -0,0 +1,68 @@
+#ifndef ZOBRIST_H
+#define ZOBRIST_H
+
+#include <cstdint>
+#include <array>
+
+// Random keys for incrementally hashing a board.
+// Sides are absolute (0 and 1), so a board keeps the same key whichever team it's viewed from.
+// King keys are an overlay: a king's cell is hashed with both its piece key and its king key.
+// Spawn counts have no fixed limit (taking a piece with a king earns one), so their keys are mixed from the count
+// rather than looked up, and every count gets its own.
+template <unsigned int num_cells>
+class Zobrist {
+public:
+    typedef std::uint64_t KeyType;
+
+    static const Zobrist<num_cells> keys;
+
+    Zobrist() {
+        KeyType state = 0x9E3779B97F4A7C15ull ^ num_cells;
+
+        for (unsigned int side = 0; side < 2; side++) {
+            for (unsigned int i = 0; i < num_cells; i++) {
+                piece_keys[side][i] = next(state);
+                king_keys[side][i] = next(state);
+            }
+            spawn_seeds[side] = next(state);
+        }
+
+        side_key = next(state);
+    }
+
+    KeyType piece(unsigned int side, unsigned int cell) const {
+        return piece_keys[side][cell];
+    }
+
+    KeyType king(unsigned int side, unsigned int cell) const {
+        return king_keys[side][cell];
+    }
+
+    KeyType spawns(unsigned int side, unsigned int count) const {
+        KeyType state = spawn_seeds[side] + count * 0xD1B54A32D192ED03ull;
+        return next(state);
+    }
+
+    KeyType side_to_move() const {
+        return side_key;
+    }
+
+private:
+    std::array<std::array<KeyType, num_cells>, 2> piece_keys;
+    std::array<std::array<KeyType, num_cells>, 2> king_keys;
+    std::array<KeyType, 2> spawn_seeds;
+    KeyType side_key;
+
+    static KeyType next(KeyType &state) {
+        // splitmix64
+        KeyType res = (state += 0x9E3779B97F4A7C15ull);
+        res = (res ^ (res >> 30)) * 0xBF58476D1CE4E5B9ull;
+        res = (res ^ (res >> 27)) * 0x94D049BB133111EBull;
+        return res ^ (res >> 31);
+    }
+};
+
+template <unsigned int num_cells>
+const Zobrist<num_cells> Zobrist<num_cells>::keys;
+
+#endif // ZOBRIST_H